@@ -0,0 +1,511 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+#include "svmreader.hpp"
+#include "dense.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+
+// count heap allocations so that each benchmark can report allocations per operation;
+// every replaceable form is defined so that array and sized deletes also pair with malloc/free
+static std::atomic<uint64_t> n_allocations(0);
+
+void* counted_alloc(size_t size){
+  n_allocations.fetch_add(1, std::memory_order_relaxed);
+  void* p = malloc(size ? size : 1);
+  if (!p){
+    throw bad_alloc();
+  }
+  return p;
+}
+
+void* operator new(size_t size){
+  return counted_alloc(size);
+}
+
+void* operator new[](size_t size){
+  return counted_alloc(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  try {
+    return counted_alloc(size);
+  }
+  catch (...){
+    return NULL;
+  }
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  try {
+    return counted_alloc(size);
+  }
+  catch (...){
+    return NULL;
+  }
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+void operator delete[](void* p) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+  free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+  free(p);
+}
+
+
+struct bench_result {
+  double ns_per_op;
+  double allocs_per_op;
+};
+
+
+// run f (which performs ops_per_call operations) iterations times per repetition,
+// and report the median repetition, so that runs are comparable
+template<typename Func>
+bench_result run_bench(Func f, int iterations, double ops_per_call, int repeat){
+  f(); // warm up caches and lazily allocated buffers
+  vector<double> ns;
+  uint64_t allocs = 0;
+  for (int r=0; r<repeat; r++){
+    uint64_t allocs_before = n_allocations.load();
+    high_resolution_clock::time_point t1 = high_resolution_clock::now();
+    for (int i=0; i<iterations; i++){
+      f();
+    }
+    high_resolution_clock::time_point t2 = high_resolution_clock::now();
+    allocs = n_allocations.load() - allocs_before;
+    ns.push_back(duration_cast<nanoseconds>(t2 - t1).count() / (iterations * ops_per_call));
+  }
+  sort(ns.begin(), ns.end());
+  bench_result res;
+  res.ns_per_op = ns[ns.size() / 2];
+  res.allocs_per_op = allocs / (iterations * ops_per_call);
+  return res;
+}
+
+
+void print_header(const string& title){
+  cout << "\n[" << title << "]\n";
+  cout << setw(44) << left << "benchmark" << right << setw(14) << "ns/op" << setw(14) << "allocs/op" << setw(14) << "ops/s" << '\n';
+}
+
+
+void print_result(const string& name, const bench_result& res){
+  cout << setw(44) << left << name << right << fixed << setprecision(1) << setw(14) << res.ns_per_op
+       << setprecision(2) << setw(14) << res.allocs_per_op << setprecision(0) << setw(14) << 1e9 / res.ns_per_op << '\n';
+  cout.unsetf(ios::floatfield);
+  cout << setprecision(6);
+}
+
+
+// the float parser used by svm_reader before the exact parser, kept for comparison
+float legacy_strtof(const char *p, const char* end){
+  bool sign = true;
+  if (p < end && *p == '-') {
+    sign = false; ++p;
+  } else if (p < end && *p == '+') {
+    ++p;
+  }
+  float value;
+  for (value = 0; p < end && isdigit(*p); ++p) {
+    value = value * 10.0f + (*p - '0');
+  }
+  if (p < end && *p == '.') {
+    uint64_t pow10 = 1;
+    uint64_t val2 = 0;
+    ++p;
+    while (p < end && isdigit(*p)) {
+      val2 = val2 * 10 + (*p - '0');
+      pow10 *= 10;
+      ++p;
+    }
+    value += static_cast<float>(static_cast<double>(val2) / static_cast<double>(pow10));
+  }
+  if (p < end && ((*p == 'e') || (*p == 'E'))) {
+    ++p;
+    bool frac = false;
+    float scale = 1.0;
+    unsigned expon;
+    if (p < end && *p == '-') {
+      frac = true;
+      ++p;
+    } else if (p < end && *p == '+') {
+      ++p;
+    }
+    for (expon = 0; p < end && isdigit(*p); p += 1) {
+      expon = expon * 10 + (*p - '0');
+    }
+    if (expon > 38) expon = 38;
+    while (expon >=  8) { scale *= 1E8;  expon -=  8; }
+    while (expon >   0) { scale *= 10.0; expon -=  1; }
+    value = frac ? (value / scale) : (value * scale);
+  }
+  return sign ? value : - value;
+}
+
+
+// space separated numbers in the formats found in LIBSVM files: short literals, %.9g and %.17g
+string make_number_text(int n, unsigned seed){
+  mt19937_64 rng(seed);
+  uniform_real_distribution<double> uniform(0.0, 1.0);
+  string text;
+  char buf[64];
+  for (int i=0; i<n; i++){
+    double v = uniform(rng);
+    switch (i % 4){
+      case 0: snprintf(buf, sizeof(buf), "%.17g ", v); break;
+      case 1: snprintf(buf, sizeof(buf), "%.9g ", v); break;
+      case 2: snprintf(buf, sizeof(buf), "%.16g ", v * 1000); break;
+      default: snprintf(buf, sizeof(buf), "%d ", int(v * 10)); break;
+    }
+    text += buf;
+  }
+  return text;
+}
+
+
+// run parse(token, token_end, value) over every token, return the best ns per value of several repetitions
+template<typename Parser>
+double time_parser(const string& text, Parser parse, double& checksum, int repeat){
+  double best = numeric_limits<double>::max();
+  for (int r=0; r<repeat; r++){
+    high_resolution_clock::time_point t1 = high_resolution_clock::now();
+    const char* p = text.data();
+    const char* end = p + text.size();
+    size_t count = 0;
+    double sum = 0;
+    while (p < end){
+      const char* token_end = (const char*)memchr(p, ' ', end - p);
+      sum += parse(p, token_end);
+      p = token_end + 1;
+      count++;
+    }
+    high_resolution_clock::time_point t2 = high_resolution_clock::now();
+    best = min(best, duration_cast<nanoseconds>(t2 - t1).count() / double(count));
+    checksum = sum;
+  }
+  return best;
+}
+
+
+void bench_parsers(int n, int repeat){
+  string text = make_number_text(n, 2019);
+  cout << "\n[number parsing] " << n << " values, " << text.size() << " bytes, best of " << repeat << " runs\n";
+  // correctness against strtod
+  vector<double> reference;
+  int n_mismatch_fast = 0;
+  int n_mismatch_legacy = 0;
+  const char* p = text.data();
+  const char* end = p + text.size();
+  while (p < end){
+    const char* token_end = (const char*)memchr(p, ' ', end - p);
+    double ref = strtod(string(p, token_end).c_str(), NULL);
+    double fast;
+    parse_double(p, token_end, fast);
+    n_mismatch_fast += (fast != ref);
+    n_mismatch_legacy += (double(legacy_strtof(p, token_end)) != ref);
+    p = token_end + 1;
+  }
+  double checksum;
+  double ns_legacy = time_parser(text, [](const char* s, const char* e){ return double(legacy_strtof(s, e)); }, checksum, repeat);
+  double ns_strtod = time_parser(text, [](const char* s, const char* e){ char* stop; return strtod(s, &stop); }, checksum, repeat);
+  double ns_fast = time_parser(text, [](const char* s, const char* e){ double v; parse_double(s, e, v); return v; }, checksum, repeat);
+  double bytes_per_value = text.size() / double(n);
+  cout << setw(16) << "parser" << setw(12) << "ns/value" << setw(12) << "MB/s" << setw(16) << "!= strtod" << '\n';
+  cout << setw(16) << "legacy strtof" << setw(12) << ns_legacy << setw(12) << bytes_per_value * 1000 / ns_legacy << setw(16) << n_mismatch_legacy << '\n';
+  cout << setw(16) << "strtod" << setw(12) << ns_strtod << setw(12) << bytes_per_value * 1000 / ns_strtod << setw(16) << 0 << '\n';
+  cout << setw(16) << "parse_double" << setw(12) << ns_fast << setw(12) << bytes_per_value * 1000 / ns_fast << setw(16) << n_mismatch_fast << '\n';
+}
+
+
+void bench_reader(const string& file, int repeat){
+  double best = numeric_limits<double>::max();
+  uint64_t allocs = 0;
+  example_data data;
+  for (int r=0; r<repeat; r++){
+    example_data loaded;
+    uint64_t allocs_before = n_allocations.load();
+    high_resolution_clock::time_point t1 = high_resolution_clock::now();
+    svm_reader reader(file, loaded);
+    reader.load();
+    high_resolution_clock::time_point t2 = high_resolution_clock::now();
+    allocs = n_allocations.load() - allocs_before;
+    best = min(best, duration_cast<nanoseconds>(t2 - t1).count() / 1e9);
+    swap(data, loaded);
+  }
+  struct stat st;
+  stat(file.c_str(), &st);
+  cout << "\n[svm_reader::load] " << file << ": " << data.size() << " examples, " << data.values.size() << " values, "
+       << best * 1000 << " ms, " << st.st_size / best / 1e6 << " MB/s, " << allocs << " allocations\n";
+}
+
+
+// a bundled model and the dataset it was trained for
+struct bench_model {
+  string name;
+  string model_file;
+  string data_file;
+  int feature_start;
+  vector<vector<Leaf>> leaves;
+  vector<vector<double>> points;
+  vector<int> labels;
+};
+
+
+bool load_model(bench_model& m, int n_points){
+  ifstream tree_data(m.model_file);
+  if (!tree_data){
+    cout << "\nskipping " << m.name << ": cannot open " << m.model_file << " (run treeBench from the repository root)\n";
+    return false;
+  }
+  json model;
+  tree_data >> model;
+  for (int i=0; i<model.size(); i++){
+    interval_map<int,Interval> no_constr;
+    vector<Leaf> one_tree_leaves;
+    dfs(model[i], i, no_constr, one_tree_leaves, -1);
+    m.leaves.push_back(one_tree_leaves);
+  }
+  example_data data;
+  read_libsvm(m.data_file, data, 0, n_points);
+  for (size_t i=0; i<data.size(); i++){
+    vector<double> x;
+    data.dense_row(i, x, m.feature_start);
+    m.points.push_back(x);
+    m.labels.push_back(int(data.y[i]));
+  }
+  return true;
+}
+
+
+// synthetic boxes over n_feat features with depth constraints each, and points in [0, 1]^n_feat
+void make_synthetic(int n_boxes, int n_feat, int depth, unsigned seed, vector<interval_map<int,Interval>>& boxes, vector<vector<double>>& points){
+  mt19937_64 rng(seed);
+  uniform_real_distribution<double> uniform(0.0, 1.0);
+  uniform_int_distribution<int> feature(0, n_feat - 1);
+  boxes.clear();
+  for (int i=0; i<n_boxes; i++){
+    interval_map<int,Interval> box;
+    for (int d=0; d<depth; d++){
+      double threshold = uniform(rng);
+      if (uniform(rng) < 0.5){
+        box_intersec(box, build_1D_box(feature(rng), -numeric_limits<float>::max(), threshold));
+      }
+      else {
+        box_intersec(box, build_1D_box(feature(rng), threshold, numeric_limits<float>::max()));
+      }
+    }
+    if (box.find(-100) == box.end()){
+      boxes.push_back(box);
+    }
+  }
+  points.assign(64, vector<double>(n_feat));
+  for (auto& p : points){
+    for (auto& v : p){
+      v = uniform(rng);
+    }
+  }
+}
+
+
+void bench_boxes(const string& name, const vector<interval_map<int,Interval>>& boxes, const vector<vector<double>>& points, int feature_start, int repeat){
+  print_header(name + ": box kernels, " + to_string(boxes.size()) + " boxes");
+  // fixed pseudo-random pairs of boxes
+  mt19937 rng(7);
+  vector<pair<int,int>> pairs(4096);
+  for (auto& p : pairs){
+    p = make_pair(int(rng() % boxes.size()), int(rng() % boxes.size()));
+  }
+  volatile int sink = 0;
+  print_result("box_intersec (copy + intersect)", run_bench([&](){
+    for (const auto& p : pairs){
+      interval_map<int,Interval> box = boxes[p.first];
+      sink += box_intersec(box, boxes[p.second]);
+    }
+  }, 20, pairs.size(), repeat));
+  volatile double dist_sink = 0;
+  print_result("point_box_dist (linf)", run_bench([&](){
+    for (const auto& box : boxes){
+      dist_sink += point_box_dist_norm<NORM_LINF>(points[0], box, feature_start, false, -100);
+    }
+  }, 20, boxes.size(), repeat));
+}
+
+
+void bench_model_kernels(bench_model& m, double eps, int max_clique, int repeat){
+  vector<interval_map<int,Interval>> boxes;
+  size_t n_leaves = 0;
+  for (const auto& tree : m.leaves){
+    for (const auto& leaf : tree){
+      boxes.push_back(leaf.box);
+    }
+    n_leaves += tree.size();
+  }
+  bench_boxes(m.name, boxes, m.points, m.feature_start, repeat);
+
+  print_header(m.name + ": " + to_string(m.leaves.size()) + " trees, " + to_string(n_leaves) + " leaves, eps " + to_string(eps) + ", one op = one point");
+  int n_points = min(int(m.points.size()), 8);
+  print_result("find_reachable_leaves", run_bench([&](){
+    for (int i=0; i<n_points; i++){
+      find_reachable_leaves(m.points[i], m.leaves, eps, m.labels[i], -1, 2, m.feature_start, false, -100);
+    }
+  }, 3, n_points, repeat));
+  vector<vector<vector<Leaf>>> reachable;
+  for (int i=0; i<n_points; i++){
+    reachable.push_back(find_reachable_leaves(m.points[i], m.leaves, eps, m.labels[i], -1, 2, m.feature_start, false, -100));
+  }
+  for (int dp=0; dp<=1; dp++){
+    print_result(string("find_k_partite_clique (max_clique ") + to_string(max_clique) + (dp ? ", DP)" : ")"), run_bench([&](){
+      for (int i=0; i<n_points; i++){
+        find_k_partite_clique(reachable[i], max_clique, eps, m.labels[i], -1, 2, dp);
+      }
+    }, 1, n_points, repeat));
+  }
+
+  // the same kernels on dense boxes, points projected once beforehand
+  feature_map features;
+  features.build(m.leaves);
+  Interval unconstrained = {-numeric_limits<float>::max(), numeric_limits<float>::max()};
+  vector<box_list> dense_trees = dense_leaves(m.leaves, features, unconstrained);
+  vector<leaf_bounds> tree_bounds;
+  for (const auto& tree : dense_trees){
+    tree_bounds.push_back(leaf_bounds(tree));
+  }
+  vector<vector<double>> projected(n_points);
+  vector<vector<vector<double>>> dist(n_points, vector<vector<double>>(tree_bounds.size()));
+  for (int i=0; i<n_points; i++){
+    features.project(m.points[i], m.feature_start, projected[i]);
+  }
+  simd_level best = simd_dispatch_level();
+  print_result(string("leaf_bounds::distances (") + simd_name(best) + ", " + to_string(features.size()) + " features)", run_bench([&](){
+    for (int i=0; i<n_points; i++){
+      for (int t=0; t<tree_bounds.size(); t++){
+        tree_bounds[t].distances(projected[i], false, -1, dist[i][t]);
+      }
+    }
+  }, 3, n_points, repeat));
+  print_result("leaf_bounds::distances (batch of " + to_string(n_points) + " points)", run_bench([&](){
+    for (int t=0; t<tree_bounds.size(); t++){
+      for (int i=0; i<n_points; i++){
+        tree_bounds[t].distances(projected[i], false, -1, dist[i][t]);
+      }
+    }
+  }, 3, n_points, repeat));
+  for (int level=SIMD_SCALAR; level<best; level++){
+    vector<double> one_dist;
+    print_result(string("linf_dist (") + simd_name(simd_level(level)) + ")", run_bench([&](){
+      for (int i=0; i<n_points; i++){
+        for (const auto& b : tree_bounds){
+          one_dist.resize(b.stride);
+          if (level == SIMD_SCALAR){
+            linf_dist_scalar(projected[i].data(), b.k, b.lower.data(), b.upper.data(), b.stride, 0, b.stride, one_dist.data());
+          }
+#ifdef TREEVERIFY_X86_SIMD
+          else {
+            linf_dist_avx2(projected[i].data(), b.k, b.lower.data(), b.upper.data(), b.stride, 0, b.stride, one_dist.data());
+          }
+#endif
+        }
+      }
+    }, 3, n_points, repeat));
+  }
+  print_result("find_reachable_leaves_dense", run_bench([&](){
+    for (int i=0; i<n_points; i++){
+      find_reachable_leaves_dense(dist[i], dense_trees, tree_bounds, eps, m.labels[i], -1, 2);
+    }
+  }, 3, n_points, repeat));
+  vector<vector<box_list>> dense_reachable;
+  for (int i=0; i<n_points; i++){
+    dense_reachable.push_back(find_reachable_leaves_dense(dist[i], dense_trees, tree_bounds, eps, m.labels[i], -1, 2));
+  }
+  for (int dp=0; dp<=1; dp++){
+    for (int join=JOIN_NESTED; join<=JOIN_SWEEP; join++){
+      print_result(string("find_k_partite_clique_dense (max_clique ") + to_string(max_clique) + (dp ? ", DP" : "") + (join == JOIN_SWEEP ? ", sweep)" : ")"), run_bench([&](){
+        for (int i=0; i<n_points; i++){
+          find_k_partite_clique_dense(dense_reachable[i], max_clique, m.labels[i], -1, 2, dp, join);
+        }
+      }, 1, n_points, repeat));
+    }
+  }
+}
+
+
+// a LIBSVM file of n_rows random dense rows, for a reader benchmark independent of the bundled files
+string make_libsvm_file(int n_rows, int n_feat, unsigned seed){
+  char path[] = "/tmp/treeBench_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd == -1){
+    return "";
+  }
+  FILE* f = fdopen(fd, "w");
+  mt19937_64 rng(seed);
+  uniform_real_distribution<double> uniform(0.0, 1.0);
+  for (int i=0; i<n_rows; i++){
+    fprintf(f, "%d", int(rng() % 2));
+    for (int j=0; j<n_feat; j++){
+      fprintf(f, " %d:%.17g", j, uniform(rng));
+    }
+    fputc('\n', f);
+  }
+  fclose(f);
+  return path;
+}
+
+
+int main(int argc, char** argv){
+  int repeat = 5;
+  bench_parsers(2000000, repeat);
+
+  vector<string> reader_files(argv + 1, argv + argc);
+  reader_files.push_back("example_breast_cancer0.libsvm");
+  reader_files.push_back("ori_higgs0");
+  string synthetic_file = make_libsvm_file(100000, 28, 2019);
+  reader_files.push_back(synthetic_file);
+  for (const auto& file : reader_files){
+    if (access(file.c_str(), R_OK) == 0){
+      bench_reader(file, repeat);
+    }
+  }
+  unlink(synthetic_file.c_str());
+
+  vector<interval_map<int,Interval>> boxes;
+  vector<vector<double>> points;
+  make_synthetic(4096, 100, 6, 2019, boxes, points);
+  bench_boxes("synthetic 100 features, depth 6", boxes, points, 0, repeat);
+
+  bench_model breast_cancer = {"breast_cancer", "breast_cancer_robust.0008.json", "example_breast_cancer0.libsvm", 1};
+  if (load_model(breast_cancer, 8)){
+    bench_model_kernels(breast_cancer, 0.3, 2, repeat);
+  }
+  bench_model higgs = {"higgs", "higgs_robust.0050.json", "ori_higgs0", 0};
+  if (load_model(higgs, 8)){
+    bench_model_kernels(higgs, 0.02, 2, repeat);
+  }
+  return 0;
+}
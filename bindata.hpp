@@ -0,0 +1,246 @@
+/* Binary dataset cache: a LIBSVM file converted once, then memory mapped by every run */
+
+#pragma once
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string>
+#include <stdexcept>
+
+#include "svmreader.hpp"
+
+static_assert(sizeof(size_t) == sizeof(uint64_t), "row offsets are stored as 64-bit integers");
+
+/*!brief alignment of every section in the file */
+static const uint64_t BinDataAlign = 64;
+
+enum bin_data_layout {
+    LAYOUT_DENSE = 0, LAYOUT_CSR = 1
+};
+
+/*!
+ * \brief Header at the beginning of a binary dataset.
+ * It is followed by the labels (n_rows doubles), then either n_rows * n_feat doubles for the
+ * dense layout, or row offsets (n_rows + 1 uint64), column indices (nnz uint32) and values
+ * (nnz doubles) for CSR. Every section starts at a multiple of BinDataAlign.
+ */
+struct bin_data_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t layout;
+    uint64_t n_rows;
+    uint64_t n_feat;
+    uint64_t nnz;
+    uint64_t y_offset;
+    uint64_t row_ptr_offset;
+    uint64_t col_offset;
+    uint64_t val_offset;
+    uint64_t file_size;
+};
+
+static const char BinDataMagic[8] = {'T', 'V', 'D', 'A', 'T', 'A', '1', '\0'};
+
+/*!brief true if the file starts with the binary dataset magic */
+inline bool is_bin_data(const std::string& file) {
+    char magic[8];
+    FILE* f = fopen(file.c_str(), "rb");
+    if (!f) {
+        return false;
+    }
+    bool match = fread(magic, 1, sizeof(magic), f) == sizeof(magic) && !memcmp(magic, BinDataMagic, sizeof(magic));
+    fclose(f);
+    return match;
+}
+
+inline uint64_t bin_data_align(uint64_t offset) {
+    return (offset + BinDataAlign - 1) / BinDataAlign * BinDataAlign;
+}
+
+/*!brief true if count items of item_size bytes at offset are aligned and end within length, without overflow */
+inline bool bin_data_fits(uint64_t offset, uint64_t count, uint64_t item_size, uint64_t length) {
+    if (offset % BinDataAlign != 0 || offset > length) {
+        return false;
+    }
+    return item_size == 0 || count <= (length - offset) / item_size;
+}
+
+/*!brief write a section at offset, zero padding the gap before it */
+inline void bin_data_write(FILE* f, uint64_t& pos, uint64_t offset, const void* data, size_t bytes) {
+    static const char zeros[BinDataAlign] = {0};
+    if (fwrite(zeros, 1, offset - pos, f) != offset - pos || fwrite(data, 1, bytes, f) != bytes) {
+        throw std::runtime_error("cannot write binary dataset");
+    }
+    pos = offset + bytes;
+}
+
+/*!brief write data in the given layout */
+inline void write_bin_data(const example_data& data, const std::string& file, bin_data_layout layout) {
+    data_view v = data.view();
+    bin_data_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BinDataMagic, sizeof(header.magic));
+    header.version = 1;
+    header.layout = layout;
+    header.n_rows = v.n_rows;
+    header.n_feat = v.n_feat;
+    header.nnz = v.row_ptr[v.n_rows];
+    header.y_offset = bin_data_align(sizeof(header));
+    uint64_t end = header.y_offset + header.n_rows * sizeof(d_type);
+    if (layout == LAYOUT_DENSE) {
+        header.val_offset = bin_data_align(end);
+        end = header.val_offset + header.n_rows * header.n_feat * sizeof(d_type);
+    }
+    else {
+        header.row_ptr_offset = bin_data_align(end);
+        header.col_offset = bin_data_align(header.row_ptr_offset + (header.n_rows + 1) * sizeof(uint64_t));
+        header.val_offset = bin_data_align(header.col_offset + header.nnz * sizeof(i_type));
+        end = header.val_offset + header.nnz * sizeof(d_type);
+    }
+    header.file_size = end;
+    /* write to a temporary file and rename, so readers never map a partial file */
+    std::string tmp_file = file + "." + std::to_string(getpid());
+    FILE* f = fopen(tmp_file.c_str(), "wb");
+    if (!f) {
+        throw std::invalid_argument("cannot create " + file);
+    }
+    uint64_t pos = 0;
+    bin_data_write(f, pos, 0, &header, sizeof(header));
+    bin_data_write(f, pos, header.y_offset, v.y, header.n_rows * sizeof(d_type));
+    if (layout == LAYOUT_DENSE) {
+        std::vector<d_type> row;
+        for (size_t i = 0; i < v.n_rows; ++i) {
+            v.dense_row(i, row, 0);
+            bin_data_write(f, pos, i ? pos : header.val_offset, row.data(), row.size() * sizeof(d_type));
+        }
+    }
+    else {
+        bin_data_write(f, pos, header.row_ptr_offset, v.row_ptr, (header.n_rows + 1) * sizeof(uint64_t));
+        bin_data_write(f, pos, header.col_offset, v.col_index, header.nnz * sizeof(i_type));
+        bin_data_write(f, pos, header.val_offset, v.values, header.nnz * sizeof(d_type));
+    }
+    if (fclose(f) != 0 || rename(tmp_file.c_str(), file.c_str()) != 0) {
+        unlink(tmp_file.c_str());
+        throw std::runtime_error("cannot write binary dataset " + file);
+    }
+}
+
+/*!brief A binary dataset mapped read-only, its pages are shared by all processes using it */
+class mapped_data {
+    public:
+        mapped_data() : base(NULL), length(0) {
+        }
+        ~mapped_data() {
+            if (base) {
+                munmap(base, length);
+            }
+        }
+        /*!brief map file, throws if it is not a valid binary dataset */
+        void open(const std::string& file) {
+            int fd = ::open(file.c_str(), O_RDONLY);
+            if (fd == -1) {
+                throw std::invalid_argument("cannot open binary dataset " + file);
+            }
+            struct stat st;
+            if (fstat(fd, &st) == -1 || size_t(st.st_size) < sizeof(bin_data_header)) {
+                close(fd);
+                throw std::invalid_argument("binary dataset " + file + " is truncated");
+            }
+            length = st.st_size;
+            base = (char*)mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+            close(fd);
+            if (base == MAP_FAILED) {
+                base = NULL;
+                throw std::invalid_argument("cannot map binary dataset " + file);
+            }
+            memcpy(&header, base, sizeof(header));
+            if (memcmp(header.magic, BinDataMagic, sizeof(header.magic)) || header.version != 1 || header.file_size != length) {
+                throw std::invalid_argument(file + " is not a valid binary dataset");
+            }
+            /* view() trusts the sections, so each must lie within the file */
+            bool valid = header.y_offset >= sizeof(header) && bin_data_fits(header.y_offset, header.n_rows, sizeof(d_type), length);
+            if (header.layout == LAYOUT_DENSE) {
+                valid = valid && header.n_feat <= length / sizeof(d_type)
+                        && bin_data_fits(header.val_offset, header.n_rows, header.n_feat * sizeof(d_type), length);
+            }
+            else if (header.layout == LAYOUT_CSR) {
+                valid = valid && header.n_rows < length / sizeof(uint64_t)
+                        && bin_data_fits(header.row_ptr_offset, header.n_rows + 1, sizeof(uint64_t), length)
+                        && bin_data_fits(header.col_offset, header.nnz, sizeof(i_type), length)
+                        && bin_data_fits(header.val_offset, header.nnz, sizeof(d_type), length);
+                /* rows index values and columns index features, check both before any row is read */
+                const uint64_t* row_ptr = (const uint64_t*)(base + header.row_ptr_offset);
+                valid = valid && row_ptr[0] == 0 && row_ptr[header.n_rows] == header.nnz;
+                for (uint64_t i = 0; valid && i < header.n_rows; ++i) {
+                    valid = row_ptr[i] <= row_ptr[i + 1];
+                }
+                const i_type* col_index = (const i_type*)(base + header.col_offset);
+                for (uint64_t i = 0; valid && i < header.nnz; ++i) {
+                    valid = col_index[i] < header.n_feat;
+                }
+            }
+            else {
+                valid = false;
+            }
+            if (!valid) {
+                throw std::invalid_argument(file + " is not a valid binary dataset: sections do not match the header");
+            }
+        }
+        data_view view() const {
+            data_view v;
+            v.n_rows = header.n_rows;
+            v.n_feat = header.n_feat;
+            v.y = (const d_type*)(base + header.y_offset);
+            v.values = (const d_type*)(base + header.val_offset);
+            if (header.layout == LAYOUT_CSR) {
+                v.col_index = (const i_type*)(base + header.col_offset);
+                v.row_ptr = (const size_t*)(base + header.row_ptr_offset);
+            }
+            else {
+                v.col_index = NULL;
+                v.row_ptr = NULL;
+            }
+            return v;
+        }
+    private:
+        bin_data_header header;
+        char* base;
+        size_t length;
+        mapped_data(const mapped_data&);
+        mapped_data& operator=(const mapped_data&);
+};
+
+/*!
+ * \brief treeVerify convert-data <input.libsvm> <output> [dense|csr]
+ * Without a layout argument, dense is used when it is not larger than CSR.
+ */
+inline int convert_data(int argc, char** argv) {
+    if (argc < 4) {
+        std::cerr << "usage: " << argv[0] << " convert-data <input.libsvm> <output> [dense|csr]\n";
+        return 1;
+    }
+    example_data data;
+    read_libsvm(argv[2], data);
+    size_t nnz = data.values.size();
+    bin_data_layout layout = (nnz * (sizeof(d_type) + sizeof(i_type)) >= data.size() * data.n_feat * sizeof(d_type)) ? LAYOUT_DENSE : LAYOUT_CSR;
+    if (argc > 4) {
+        std::string requested = argv[4];
+        if (requested == "dense") {
+            layout = LAYOUT_DENSE;
+        }
+        else if (requested == "csr") {
+            layout = LAYOUT_CSR;
+        }
+        else {
+            std::cerr << "unknown layout " << requested << ", use dense or csr\n";
+            return 1;
+        }
+    }
+    write_bin_data(data, argv[3], layout);
+    std::cout << "wrote " << argv[3] << " (" << (layout == LAYOUT_DENSE ? "dense" : "csr") << "): "
+              << data.size() << " examples, " << data.n_feat << " features, " << nnz << " values\n";
+    return 0;
+}
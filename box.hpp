@@ -1,7 +1,9 @@
+#pragma once
 #include <iostream>
 #include "json/single_include/nlohmann/json.hpp"
 #include <fstream>
 #include <iomanip>
+#include <sstream>
 #include <string> 
 #include <limits>
 #include <algorithm>
@@ -18,9 +20,18 @@ template<typename Tkey, typename Tval>
 using interval_map = std::unordered_map<Tkey, Tval>;
 
 
+// type of the interval bounds of leaf boxes: XGBoost thresholds are float32, so building with
+// -DTREEVERIFY_FLOAT32 halves the size of every box without changing them
+#ifdef TREEVERIFY_FLOAT32
+typedef float bound_type;
+#else
+typedef double bound_type;
+#endif
+
+
 struct Interval{
-  double lower;
-  double upper;
+  bound_type lower;
+  bound_type upper;
 };
 
 
@@ -115,7 +126,7 @@ void print_box (const interval_map<int, Interval>& x){
 interval_map<int,Interval> build_1D_box (int attribute, double lower_bound, double upper_bound){
   // build a 1D box by constaining a single feature
   interval_map<int, Interval>  box;
-  Interval interval = {lower_bound, upper_bound};
+  Interval interval = {bound_type(lower_bound), bound_type(upper_bound)};
   box[attribute] = interval;
   return box;
 }
@@ -142,12 +153,12 @@ bool box_intersec (interval_map<int,Interval>& box1, const interval_map<int,Inte
       }
       else{
         
-        double l1 = b1->second.lower;
-        double l2 = it->second.lower; // box2[key].lower; 
-        double u1 = b1->second.upper;
-        double u2 = it->second.upper; // box2[key].upper;
-        double l = max(l1, l2);
-        double u = min(u1, u2);
+        bound_type l1 = b1->second.lower;
+        bound_type l2 = it->second.lower; // box2[key].lower; 
+        bound_type u1 = b1->second.upper;
+        bound_type u2 = it->second.upper; // box2[key].upper;
+        bound_type l = max(l1, l2);
+        bound_type u = min(u1, u2);
         Interval interval = {l,u};
         if (l >= u) {
           box1.clear();
@@ -162,90 +173,75 @@ bool box_intersec (interval_map<int,Interval>& box1, const interval_map<int,Inte
 }
 
 
-double point_interval_dist(double att_val, double l, double u, double order){
-  double dist = 0;
-  if (att_val > u){
-    if (order>0){
-      dist = pow(att_val - u, order); 
-    }
-    else{
-      if (order==0){
-        dist = 1;
-      }
-      else{
-        dist = att_val  - u;
-      }
+bool box_overlap (const interval_map<int,Interval>& box1, const interval_map<int,Interval>& box2){
+  //same result as box_intersec, without building the intersection
+  if (box1.find(-100) != box1.end() || box2.find(-100) != box2.end())
+    return false;
+  const interval_map<int,Interval>& small = (box1.size() <= box2.size()) ? box1 : box2;
+  const interval_map<int,Interval>& large = (box1.size() <= box2.size()) ? box2 : box1;
+  for (interval_map<int,Interval>::const_iterator it = small.cbegin(); it != small.cend(); ++it) {
+    auto other = large.find(it->first);
+    if (other != large.end() && max(it->second.lower, other->second.lower) >= min(it->second.upper, other->second.upper)){
+      return false;
     }
   }
-  if (att_val < l){
-    if (order>0){
-      dist = pow(l - att_val, order); 
-    }
-    else {
-      if (order==0){ 
-        dist = 1;
-      }
-      else{
-        dist = l - att_val;
-      }
-    }
+  return true;
+}
+
+
+// norms of point_box_dist_norm, named after their order; the verifier uses NORM_LINF
+enum box_norm { NORM_LINF = -1, NORM_L0 = 0, NORM_L1 = 1, NORM_L2 = 2 };
+
+
+// what one feature at distance gap >= 0 adds to the norm
+template<int Norm>
+inline double norm_term(double gap){
+  switch (Norm){
+    case NORM_L0: return (gap > 0) ? 1 : 0;
+    case NORM_L2: return gap * gap;
+    default: return gap;
   }
-  return dist;
 }
 
 
-double point_box_dist(const vector<double>& p, const interval_map<int,Interval>& b, double order, int feature_start, bool one_attr, int only_attr){
-  // order < 0 means linf norm
+// the norm from the terms of every feature combined by norm_accumulate
+template<int Norm>
+inline double norm_accumulate(double res, double term){
+  return (Norm == NORM_LINF) ? max(res, term) : res + term;
+}
+
+
+template<int Norm>
+inline double norm_finish(double res){
+  switch (Norm){
+    case NORM_L0: return double(int(res));
+    case NORM_L2: return sqrt(res);
+    default: return res;
+  }
+}
+
+
+template<int Norm>
+double point_box_dist_norm(const vector<double>& p, const interval_map<int,Interval>& b, int feature_start, bool one_attr, int only_attr){
+  // distance from p to box b in one norm, the norm is resolved at compile time
   double res = 0;
-  double dist = 0;
   for (interval_map<int, Interval>::const_iterator it = b.cbegin(); it != b.cend(); ++it) {
-    int attr = it->first; 
-    attr = attr - feature_start;
+    int attr = it->first - feature_start;
     if (attr >= p.size()){
       char buffer [100];
       sprintf (buffer, "point dimension is %d box has attribute  %d", int(p.size()), attr);
       cout << "point dimension is " << p.size() << ", box has attribute " << attr << '\n';
       throw invalid_argument(buffer);
-      //throw invalid_argument("box and point are not compatible");
     }
-    double l = it->second.lower;
-    double u = it->second.upper; 
-    dist = point_interval_dist(p[attr], l, u, order);
+    double x = p[attr];
+    double gap = (x > it->second.upper) ? x - it->second.upper : ((x < it->second.lower) ? it->second.lower - x : 0);
+    double dist = norm_term<Norm>(gap);
     if (one_attr && only_attr != attr && dist > 0){
-      return std::numeric_limits<double>::max(); 
-    }
-    if (order>=0){
-      res = res + dist;
-    }
-    else {
-      res = max(res, dist);
-    }
-  } 
-  if (order>0){
-    return pow(res, 1/order);
-  }
-  else{
-    if (order==0){
-      return double(int(res));
-    }
-    else{
-      return res;
+      return std::numeric_limits<double>::max();
     }
+    res = norm_accumulate<Norm>(res, dist);
   }
-}
-
-
-void read_libsvm(string data_file, vector<vector<double>>&X, vector<int>&y, bool binary){
-  X.clear();
-  y.clear();
-  example_data test_data;
-  svm_reader reader(data_file, test_data);
-  reader.load();
-  cout << "\ndata shape:" << test_data.data_mat.size() << " * " << test_data.data_mat[0].f_data.size() <<'\n';
-  for (int i=0; i< test_data.data_mat.size(); i++){
-    y.push_back(test_data.y[i]);
-    X.push_back(test_data.data_mat[i].f_data); 
-  }
+  return norm_finish<Norm>(res);
 }
 
 
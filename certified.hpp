@@ -0,0 +1,148 @@
+#pragma once
+// Certified bounds of verified points, reused for nearby points. If x is verified robust within r for
+// its label, every point of the L-inf ball of radius r around x gets that label, so a point x' of the
+// same label at distance d < r from x is robust within r - d: its ball of radius r - d lies inside.
+// Features the model does not split on cannot change its output and are left out of the distance.
+
+#include <vector>
+#include <algorithm>
+#include <math.h>
+
+
+// points of one label and their certified bounds, over k features. The points are kept in a k-d tree
+// whose nodes hold the bounding box of their points and the largest bound among them: no point of a
+// node at L-inf distance dist from x reuses more than its largest bound - dist, so a lookup skips every
+// node that cannot beat the best reuse found so far. Points added since the tree was built are scanned;
+// the tree is rebuilt whenever the points double, so they never outnumber those in the tree.
+struct certified_index {
+  // points per leaf of the tree, and the fewest points for which a tree is built
+  static const size_t LeafPoints = 16;
+  struct node {
+    // the points order[begin] .. order[end-1]
+    size_t begin;
+    size_t end;
+    // children, -1 for a leaf
+    int left;
+    int right;
+    double max_bound;
+  };
+  int k;
+  // k coordinates per point
+  std::vector<double> points;
+  std::vector<double> bounds;
+  // tree over the first indexed points, node i has the box lower[i * k + f] .. upper[i * k + f]
+  size_t indexed;
+  std::vector<size_t> order;
+  std::vector<node> nodes;
+  std::vector<double> lower;
+  std::vector<double> upper;
+
+  explicit certified_index(int k) : k(k), indexed(0) {}
+
+  size_t size() const {
+    return bounds.size();
+  }
+
+  // bound of point i less its distance to x if that is above best, else best; the distance stops
+  // being computed once it is too large to improve on best
+  double reuse(const double* x, size_t i, double best) const {
+    const double* p = points.data() + i * k;
+    double limit = bounds[i] - best;
+    double d = 0;
+    for (int f=0; f<k && d<limit; f++){
+      d = std::max(d, fabs(x[f] - p[f]));
+    }
+    return (d < limit) ? bounds[i] - d : best;
+  }
+
+  // L-inf distance from x to the box of node i
+  double box_dist(const double* x, int i) const {
+    const double* l = &lower[i * k];
+    const double* u = &upper[i * k];
+    double d = 0;
+    for (int f=0; f<k; f++){
+      d = std::max(d, std::max(l[f] - x[f], x[f] - u[f]));
+    }
+    return d;
+  }
+
+  // best reuse of x over the points of node i and best
+  double search(const double* x, int i, double best) const {
+    const node& n = nodes[i];
+    if (n.max_bound - box_dist(x, i) <= best){
+      return best;
+    }
+    if (n.left < 0){
+      for (size_t j=n.begin; j<n.end; j++){
+        best = reuse(x, order[j], best);
+      }
+      return best;
+    }
+    // the nearer child first, so the other one is more likely skipped
+    bool left_first = box_dist(x, n.left) <= box_dist(x, n.right);
+    best = search(x, left_first ? n.left : n.right, best);
+    return search(x, left_first ? n.right : n.left, best);
+  }
+
+  // largest bound less distance to x over the stored points, 0 if x is not closer to any of them than its bound
+  double lower_bound(const double* x) const {
+    double best = (indexed > 0) ? search(x, 0, 0) : 0;
+    for (size_t i=indexed; i<size(); i++){
+      best = reuse(x, i, best);
+    }
+    return best;
+  }
+
+  void insert(const double* x, double bound){
+    points.insert(points.end(), x, x + k);
+    bounds.push_back(bound);
+    if (size() >= 2 * std::max(indexed, LeafPoints)){
+      indexed = size();
+      order.resize(indexed);
+      for (size_t i=0; i<indexed; i++){
+        order[i] = i;
+      }
+      nodes.clear();
+      lower.clear();
+      upper.clear();
+      build(0, indexed);
+    }
+  }
+
+  // node of the points order[begin] .. order[end-1], split at the median of the feature on which
+  // they spread the most
+  int build(size_t begin, size_t end){
+    int i = int(nodes.size());
+    node n = {begin, end, -1, -1, 0};
+    std::vector<double>::const_iterator first = points.begin() + order[begin] * k;
+    lower.insert(lower.end(), first, first + k);
+    upper.insert(upper.end(), first, first + k);
+    for (size_t j=begin; j<end; j++){
+      const double* p = points.data() + order[j] * k;
+      for (int f=0; f<k; f++){
+        lower[i * k + f] = std::min(lower[i * k + f], p[f]);
+        upper[i * k + f] = std::max(upper[i * k + f], p[f]);
+      }
+      n.max_bound = std::max(n.max_bound, bounds[order[j]]);
+    }
+    nodes.push_back(n);
+    if (end - begin <= LeafPoints || k == 0){
+      return i;
+    }
+    int axis = 0;
+    for (int f=1; f<k; f++){
+      if (upper[i * k + f] - lower[i * k + f] > upper[i * k + axis] - lower[i * k + axis]){
+        axis = f;
+      }
+    }
+    size_t mid = begin + (end - begin) / 2;
+    std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end, [this, axis](size_t a, size_t b){
+      return points[a * k + axis] < points[b * k + axis];
+    });
+    int left = build(begin, mid);
+    int right = build(mid, end);
+    nodes[i].left = left;
+    nodes[i].right = right;
+    return i;
+  }
+};
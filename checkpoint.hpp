@@ -0,0 +1,137 @@
+/* Checkpoints of long runs: finished points are appended to a file and skipped when the run is started again */
+
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string>
+#include <map>
+#include <fstream>
+#include <stdexcept>
+
+#include "json/single_include/nlohmann/json.hpp"
+
+/*!brief FNV-1a hash of the bytes of a file, throws invalid_argument if it cannot be read */
+inline uint64_t file_hash(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::invalid_argument("cannot open " + path);
+    }
+    uint64_t h = 14695981039346656037ULL;
+    char buf[1 << 16];
+    while (in.read(buf, sizeof(buf)) || in.gcount() > 0) {
+        for (std::streamsize i = 0; i < in.gcount(); ++i) {
+            h = (h ^ uint8_t(buf[i])) * 1099511628211ULL;
+        }
+    }
+    return h;
+}
+
+/*!
+ * \brief A file of one JSON line per finished point, after a header line naming the run.
+ * open() reads the points of an earlier run with the same header, or starts the file if there is none;
+ * a last line cut short by a crash is dropped. Lines are appended with append() and are on disk once
+ * sync() returns, so a run killed at any time loses at most the points since the last sync().
+ */
+class checkpoint_log {
+    public:
+        checkpoint_log() : file(NULL) {
+        }
+        ~checkpoint_log() {
+            if (file) {
+                fclose(file);
+            }
+        }
+
+        /*!brief open path for the run described by header; throws invalid_argument if it belongs to another run */
+        void open(const std::string& path, const nlohmann::json& header) {
+            std::ifstream in(path, std::ios::binary);
+            long good_end = 0;
+            bool exists = false;
+            if (in) {
+                std::string line;
+                bool first = true;
+                long offset = 0;
+                while (std::getline(in, line)) {
+                    long next = offset + long(line.size()) + 1;
+                    if (in.eof()) {
+                        /* no newline: the line was being written when the run stopped */
+                        break;
+                    }
+                    nlohmann::json record = nlohmann::json::parse(line, NULL, false);
+                    if (record.is_discarded()) {
+                        break;
+                    }
+                    if (first) {
+                        if (record != header) {
+                            throw std::invalid_argument("checkpoint " + path + " was written by another run (config or model changed), remove it to start over");
+                        }
+                        exists = true;
+                        first = false;
+                    }
+                    else {
+                        points[int(record["index"])] = record;
+                    }
+                    good_end = next;
+                    offset = next;
+                }
+            }
+            in.close();
+            if (exists) {
+                file = fopen(path.c_str(), "r+");
+                if (!file || ftruncate(fileno(file), good_end) != 0 || fseek(file, good_end, SEEK_SET) != 0) {
+                    throw std::invalid_argument("cannot append to checkpoint " + path);
+                }
+            }
+            else {
+                file = fopen(path.c_str(), "w");
+                if (!file) {
+                    throw std::invalid_argument("cannot create checkpoint " + path);
+                }
+                append(header);
+                sync();
+                /* make the new file itself durable */
+                std::string dir = path.find('/') == std::string::npos ? "." : path.substr(0, path.rfind('/') + 1);
+                int dir_fd = ::open(dir.c_str(), O_RDONLY);
+                if (dir_fd != -1) {
+                    fsync(dir_fd);
+                    close(dir_fd);
+                }
+            }
+        }
+
+        bool is_open() const {
+            return file != NULL;
+        }
+
+        /*!brief true if point index was finished by an earlier run */
+        bool contains(int index) const {
+            return points.count(index) > 0;
+        }
+
+        /*!brief records of the points finished by earlier runs, by index */
+        const std::map<int, nlohmann::json>& finished() const {
+            return points;
+        }
+
+        void append(const nlohmann::json& record) {
+            std::string line = record.dump();
+            line.push_back('\n');
+            if (fwrite(line.data(), 1, line.size(), file) != line.size()) {
+                throw std::runtime_error("cannot write checkpoint");
+            }
+        }
+
+        void sync() {
+            if (fflush(file) != 0 || fsync(fileno(file)) != 0) {
+                throw std::runtime_error("cannot write checkpoint");
+            }
+        }
+
+    private:
+        FILE* file;
+        std::map<int, nlohmann::json> points;
+        checkpoint_log(const checkpoint_log&);
+        checkpoint_log& operator=(const checkpoint_log&);
+};
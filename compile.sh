@@ -1 +1,4 @@
-g++ -march=native -g -O3 -std=c++11 getBound.cc -lboost_program_options -lboost_thread -lboost_system -lpthread -luv -o treeVerify
+g++ -g -O3 -std=c++11 $CXXFLAGS -c verifier.cc -o verifier.o
+ar rcs libtreeverify.a verifier.o
+g++ -g -O3 -std=c++11 $CXXFLAGS getBound.cc -L. -ltreeverify -lboost_program_options -lboost_thread -lboost_system -lpthread -lnuma -o treeVerify
+g++ -g -O3 -std=c++11 $CXXFLAGS benchmark.cc -lboost_thread -lboost_system -lpthread -o treeBench
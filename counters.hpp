@@ -0,0 +1,113 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include <chrono>
+#include "json/single_include/nlohmann/json.hpp"
+
+// Hot-path counters. They are only collected when compiled with -DTREEVERIFY_COUNTERS,
+// otherwise every PERF() statement and PERF_CLOCK() timer is removed by the preprocessor.
+// PERF_KEEP(size_t n =) f(); always calls f but only keeps its result with counters.
+#ifdef TREEVERIFY_COUNTERS
+#define PERF(...) do { __VA_ARGS__; } while (0)
+#define PERF_CLOCK(name) std::chrono::high_resolution_clock::time_point name = std::chrono::high_resolution_clock::now()
+#define PERF_KEEP(...) __VA_ARGS__
+#else
+#define PERF(...) do {} while (0)
+#define PERF_CLOCK(name)
+#define PERF_KEEP(...)
+#endif
+
+/*!brief microseconds since a PERF_CLOCK */
+#define PERF_US_SINCE(name) (std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - (name)).count() / 1000.0)
+
+
+/*!brief work done while verifying one point, or summed over a run */
+struct perf_counters {
+  /*!brief reachable leaves on each tree, summed over eps steps and target classes */
+  std::vector<uint64_t> reachable_leaves;
+  /*!brief clique intersections attempted and non-empty, indexed by [level][group] */
+  std::vector<std::vector<uint64_t>> intersections_tried;
+  std::vector<std::vector<uint64_t>> intersections_found;
+  /*!brief time spent joining each group, indexed by [level][group], microseconds */
+  std::vector<std::vector<double>> group_us;
+  /*!brief largest clique list (LL_new) seen, in entries and estimated bytes */
+  uint64_t peak_cliques;
+  uint64_t peak_clique_bytes;
+  /*!brief box pairs checked by the DP stage */
+  uint64_t dp_pair_checks;
+  /*!brief level 0 groups found in the clique cache and not found there */
+  uint64_t clique_cache_hits;
+  uint64_t clique_cache_misses;
+  /*!brief time per level and per eps step of the binary search, microseconds */
+  std::vector<double> level_us;
+  std::vector<double> eps_step_us;
+  /*!brief number of points summed into these counters */
+  uint64_t points;
+
+  perf_counters() : peak_cliques(0), peak_clique_bytes(0), dp_pair_checks(0), clique_cache_hits(0), clique_cache_misses(0), points(0) {}
+
+  void clear(){
+    *this = perf_counters();
+  }
+
+  template<typename T>
+  static T& at(std::vector<T>& v, size_t i){
+    if (v.size() <= i){
+      v.resize(i + 1);
+    }
+    return v[i];
+  }
+
+  template<typename T>
+  static T& at(std::vector<std::vector<T>>& v, size_t i, size_t j){
+    return at(at(v, i), j);
+  }
+
+  template<typename T>
+  static void sum_into(std::vector<T>& to, const std::vector<T>& from){
+    for (size_t i=0; i<from.size(); i++){
+      at(to, i) += from[i];
+    }
+  }
+
+  template<typename T>
+  static void sum_into(std::vector<std::vector<T>>& to, const std::vector<std::vector<T>>& from){
+    for (size_t i=0; i<from.size(); i++){
+      sum_into(at(to, i), from[i]);
+    }
+  }
+
+  /*!brief add the counters of another point or run, peaks are maxed */
+  void add(const perf_counters& other){
+    sum_into(reachable_leaves, other.reachable_leaves);
+    sum_into(intersections_tried, other.intersections_tried);
+    sum_into(intersections_found, other.intersections_found);
+    sum_into(group_us, other.group_us);
+    peak_cliques = std::max(peak_cliques, other.peak_cliques);
+    peak_clique_bytes = std::max(peak_clique_bytes, other.peak_clique_bytes);
+    dp_pair_checks += other.dp_pair_checks;
+    clique_cache_hits += other.clique_cache_hits;
+    clique_cache_misses += other.clique_cache_misses;
+    sum_into(level_us, other.level_us);
+    sum_into(eps_step_us, other.eps_step_us);
+    points += other.points;
+  }
+
+  nlohmann::json to_json() const {
+    nlohmann::json j;
+    j["points"] = points;
+    j["reachable_leaves"] = reachable_leaves;
+    j["intersections_tried"] = intersections_tried;
+    j["intersections_found"] = intersections_found;
+    j["group_us"] = group_us;
+    j["peak_cliques"] = peak_cliques;
+    j["peak_clique_bytes"] = peak_clique_bytes;
+    j["dp_pair_checks"] = dp_pair_checks;
+    j["clique_cache_hits"] = clique_cache_hits;
+    j["clique_cache_misses"] = clique_cache_misses;
+    j["level_us"] = level_us;
+    j["eps_step_us"] = eps_step_us;
+    return j;
+  }
+};
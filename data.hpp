@@ -201,12 +201,65 @@ struct synth_feature : public feature {
 
 };
 
-/*!brief Data structure holding the entire training data */
+/*!brief Read-only view of a dataset, either CSR rows or dense rows of n_feat values */
+struct data_view {
+    /*!brief number of examples */
+    size_t n_rows;
+    /*!brief number of features */
+    size_t n_feat;
+    /*!brief label of each example */
+    const d_type* y;
+    /*!brief feature values, row by row */
+    const d_type* values;
+    /*!brief feature index of each value, NULL for dense rows */
+    const i_type* col_index;
+    /*!brief values of example i start at values[row_ptr[i]], NULL for dense rows */
+    const size_t* row_ptr;
+    size_t size() const {
+        return n_rows;
+    }
+    /*!brief view of examples start to start + count - 1 */
+    data_view slice(size_t start, size_t count) const {
+        data_view v = *this;
+        start = std::min(start, n_rows);
+        v.n_rows = std::min(count, n_rows - start);
+        v.y = y + start;
+        if (row_ptr) {
+            v.row_ptr = row_ptr + start;
+        }
+        else {
+            v.values = values + start * n_feat;
+        }
+        return v;
+    }
+    /*!brief dense copy of one example: feature f goes to x[f - feature_start], missing features are 0.
+     * x has at least min_size entries, so a slice whose rows lack the last features still covers the model */
+    void dense_row(size_t example_index, std::vector<d_type>& x, size_t feature_start, size_t min_size = 0) const {
+        if (!row_ptr) {
+            const d_type* row = values + example_index * n_feat;
+            x.assign(row + std::min(feature_start, n_feat), row + n_feat);
+            if (x.size() < min_size) {
+                x.resize(min_size, 0.0);
+            }
+            return;
+        }
+        x.assign(std::max(n_feat > feature_start ? n_feat - feature_start : 0, min_size), 0.0);
+        for (size_t i = row_ptr[example_index]; i < row_ptr[example_index + 1]; ++i) {
+            if (likely(col_index[i] >= feature_start)) {
+                x[col_index[i] - feature_start] = values[i];
+            }
+        }
+    }
+};
+
+/*!brief Data structure holding the entire input data, one CSR row per example */
 struct example_data {
-    /*!brief All feature data */
-    std::vector<feature> features_data;
-    /*!brief All feature data transpose */
-    std::vector<feature> data_mat;
+    /*!brief feature values of all examples, stored row by row */
+    std::vector<d_type> values;
+    /*!brief feature index of each value */
+    std::vector<i_type> col_index;
+    /*!brief values of example i are values[row_ptr[i]] to values[row_ptr[i+1]-1] */
+    std::vector<size_t> row_ptr;
     /*!brief number of features*/
     size_t n_feat;
     /*!brief Label for each example*/
@@ -221,9 +274,12 @@ struct example_data {
     std::vector<d_type> hess;
     /*!brief summation of all hessians */
     d_type total_hess;
-    example_data() : features_data(0), n_feat(0), y(0), grad(0), total_grad(0.0), hess(0), total_hess(0.0) {
+    example_data() : row_ptr(1, 0), n_feat(0), y(0), grad(0), total_grad(0.0), hess(0), total_hess(0.0) {
         y.reserve(1024);
-        features_data.reserve(1024);
+    }
+    /*!brief number of examples */
+    size_t size() const {
+        return y.size();
     }
     void add_y(d_type y_val) {
         // if (fabs(y_val) < 1e-10)
@@ -232,12 +288,14 @@ struct example_data {
     }
     // void finalize(loss_func& loss) {
     void finalize(void) {
-        /* resize to the real size */
-        features_data.resize(n_feat);
-        /* assigned feature ID to each feature */
-        for (size_t i = 0; i < features_data.size(); ++i) {
-           features_data[i].feature_id = i; 
+        /* examples without any feature get empty rows */
+        while (row_ptr.size() < y.size() + 1) {
+            row_ptr.push_back(values.size());
         }
+        /* drop the spare capacity left by exponential growth */
+        values.shrink_to_fit();
+        col_index.shrink_to_fit();
+        row_ptr.shrink_to_fit();
         /* all examples assigned to node 1 (root node) */
         nid.resize(y.size());
         std::fill(nid.begin(), nid.end(), 1);
@@ -256,24 +314,32 @@ struct example_data {
         }
         */
     }
+    /*!brief append a value to an example, examples must be added in increasing order */
     inline void add_feature_val(i_type example_index, i_type feature_index, d_type feature_value) {
-        /* if this feature is seen first time, add it to the map */
         if (n_feat <= feature_index) {
             n_feat = feature_index + 1; // assumes feature_index starts from 0
         }
-        if (features_data.size() <= feature_index) {
-            // features_data.resize(feature_index + 1);
-            // use exponential growth
-            features_data.resize(feature_index * 2 + 1);
-        }
-        features_data[feature_index].add(example_index, feature_value);
-        if (data_mat.size() <= example_index) {
-            // features_data.resize(feature_index + 1);
-            // use exponential growth
-            data_mat.resize(example_index+1);
+        /* open rows up to this example, skipped examples have no features */
+        while (row_ptr.size() < size_t(example_index) + 2) {
+            row_ptr.push_back(values.size());
         }
-        data_mat[example_index].add(feature_index, feature_value);
+        values.push_back(feature_value);
+        col_index.push_back(feature_index);
+        row_ptr.back() = values.size();
+    }
+    /*!brief read-only view of the examples, valid until the next change */
+    data_view view() const {
+        data_view v;
+        v.n_rows = size();
+        v.n_feat = n_feat;
+        v.y = y.data();
+        v.values = values.data();
+        v.col_index = col_index.data();
+        v.row_ptr = row_ptr.data();
+        return v;
+    }
+    /*!brief dense copy of one example: feature f goes to x[f - feature_start], missing features are 0 */
+    void dense_row(size_t example_index, std::vector<d_type>& x, size_t feature_start, size_t min_size = 0) const {
+        view().dense_row(example_index, x, feature_start, min_size);
     }
 };
-
-
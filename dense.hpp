@@ -0,0 +1,821 @@
+#pragma once
+// Dense leaf boxes: the features used by a model are renumbered 0..k-1 at load time, and every box is
+// stored as k consecutive intervals in a flat list, unconstrained features spanning the whole line.
+// Boxes are then intersected and compared with a point by plain loops, without hashing or allocating.
+// The functions below follow their interval_map counterparts in tree_func.hpp step by step, so
+// cliques are enumerated in the same order and the scores are the same.
+
+#include <vector>
+#include <tuple>
+#include <limits>
+#include <algorithm>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/lock_guard.hpp>
+#include "tree_func.hpp"
+#include "linf.hpp"
+
+
+// the features split on by a model, renumbered 0..size()-1 in increasing order
+struct feature_map {
+  // model feature id of each dense feature
+  vector<int> feature;
+  // dense feature of each model feature id, -1 if the model does not use it
+  vector<int> dense;
+
+  int size() const {
+    return feature.size();
+  }
+
+  void build(const vector<vector<Leaf>>& trees){
+    vector<bool> used;
+    for (int i=0; i<trees.size(); i++){
+      for (int j=0; j<trees[i].size(); j++){
+        for (auto it = trees[i][j].box.begin(); it != trees[i][j].box.end(); ++it){
+          if (it->first >= 0){
+            if (it->first >= used.size()){
+              used.resize(it->first + 1, false);
+            }
+            used[it->first] = true;
+          }
+        }
+      }
+    }
+    feature.clear();
+    dense.assign(used.size(), -1);
+    for (int f=0; f<used.size(); f++){
+      if (used[f]){
+        dense[f] = feature.size();
+        feature.push_back(f);
+      }
+    }
+  }
+
+  // dense feature of the point index attr (feature attr + feature_start), -1 if unused
+  int dense_attr(int attr, int feature_start) const {
+    int f = attr + feature_start;
+    return (f >= 0 && f < dense.size()) ? dense[f] : -1;
+  }
+
+  // the used features of x, where x[i] is feature i + feature_start
+  void project(const vector<double>& x, int feature_start, vector<double>& xd) const {
+    xd.resize(feature.size());
+    for (int d=0; d<feature.size(); d++){
+      int attr = feature[d] - feature_start;
+      if (attr < 0 || attr >= x.size()){
+        char buffer [100];
+        sprintf (buffer, "point dimension is %d box has attribute  %d", int(x.size()), attr);
+        throw invalid_argument(buffer);
+      }
+      xd[d] = x[attr];
+    }
+  }
+};
+
+
+// boxes of k intervals each, stored back to back, with a score per box
+struct box_list {
+  int k;
+  vector<Interval> bounds;
+  vector<double> value;
+  // class label of leaves (-1 for binary models and cliques)
+  vector<int> label;
+  // node id of leaves (-1 for cliques)
+  vector<int> id;
+
+  box_list(int k = 0) : k(k) {}
+
+  size_t size() const {
+    return value.size();
+  }
+
+  const Interval* box(size_t i) const {
+    return bounds.data() + i * k;
+  }
+
+  void clear(){
+    bounds.clear();
+    value.clear();
+    label.clear();
+    id.clear();
+  }
+
+  void push_back(const Interval* b, double v, int l = -1, int i = -1){
+    bounds.insert(bounds.end(), b, b + k);
+    value.push_back(v);
+    label.push_back(l);
+    id.push_back(i);
+  }
+
+  // add a leaf, features it does not constrain get the interval unconstrained
+  void push_leaf(const Leaf& leaf, const feature_map& features, Interval unconstrained){
+    size_t start = bounds.size();
+    bounds.resize(start + k, unconstrained);
+    for (auto it = leaf.box.begin(); it != leaf.box.end(); ++it){
+      bounds[start + features.dense[it->first]] = it->second;
+    }
+    value.push_back(leaf.value);
+    label.push_back(leaf.class_label);
+    id.push_back(leaf.nodeid);
+  }
+
+  // estimated memory used by the boxes
+  size_t bytes() const {
+    return bounds.size() * sizeof(Interval) + value.size() * (sizeof(double) + 2 * sizeof(int));
+  }
+};
+
+
+// leaves of every tree as dense boxes, leaves with an empty box are dropped
+vector<box_list> dense_leaves(const vector<vector<Leaf>>& trees, const feature_map& features, Interval unconstrained){
+  vector<box_list> res;
+  for (int i=0; i<trees.size(); i++){
+    res.push_back(box_list(features.size()));
+    for (int j=0; j<trees[i].size(); j++){
+      if (trees[i][j].box.find(-100) == trees[i][j].box.end()){
+        res.back().push_leaf(trees[i][j], features, unconstrained);
+      }
+    }
+  }
+  return res;
+}
+
+
+// intersect boxes a and b into out, false if the intersection is empty
+inline bool dense_box_intersec(const Interval* a, const Interval* b, Interval* out, int k){
+  for (int d=0; d<k; d++){
+    bound_type l = max(a[d].lower, b[d].lower);
+    bound_type u = min(a[d].upper, b[d].upper);
+    if (l >= u){
+      return false;
+    }
+    out[d].lower = l;
+    out[d].upper = u;
+  }
+  return true;
+}
+
+
+// true if boxes a and b intersect, the test of dense_box_intersec without the intersection
+inline bool dense_box_overlap(const Interval* a, const Interval* b, int k){
+  for (int d=0; d<k; d++){
+    if (max(a[d].lower, b[d].lower) >= min(a[d].upper, b[d].upper)){
+      return false;
+    }
+  }
+  return true;
+}
+
+
+// the feature where the most bounds of the boxes differ from the extreme bound of the list; the other
+// features are often unconstrained, so boxes are best told apart on this one
+int most_bounded_axis(const box_list& list){
+  int best_axis = 0;
+  int64_t best_bounded = -1;
+  for (int d=0; d<list.k; d++){
+    bound_type lowest = numeric_limits<bound_type>::max();
+    bound_type highest = -numeric_limits<bound_type>::max();
+    for (int j=0; j<list.size(); j++){
+      lowest = min(lowest, list.box(j)[d].lower);
+      highest = max(highest, list.box(j)[d].upper);
+    }
+    int64_t bounded = 0;
+    for (int j=0; j<list.size(); j++){
+      bounded += (list.box(j)[d].lower > lowest) + (list.box(j)[d].upper < highest);
+    }
+    if (bounded > best_bounded){
+      best_bounded = bounded;
+      best_axis = d;
+    }
+  }
+  return best_axis;
+}
+
+
+// objective of the clique search, a template parameter of the kernels: the worst score is searched,
+// the largest for a point of class 0 of a binary model and the smallest otherwise
+struct maximize_score {
+  static const int sign = 1;
+  static double worst() { return - std::numeric_limits<float>::max(); }
+  static double better(double a, double b) { return max(a, b); }
+  static bool improves(double a, double b) { return a > b; }
+};
+
+struct minimize_score {
+  static const int sign = -1;
+  static double worst() { return std::numeric_limits<float>::max(); }
+  static double better(double a, double b) { return min(a, b); }
+  static bool improves(double a, double b) { return a < b; }
+};
+
+
+// Index of the DP state for the query "best value among the boxes overlapping q". Boxes are sorted by
+// their lower bound on one feature (axis), so only a prefix can overlap q on it; the prefix is cut in
+// blocks that record their largest upper bound on axis and their best value, and a block is skipped when
+// none of its boxes reaches q on axis or none can improve the best found so far. The answer is exact.
+template<class Objective>
+struct dp_index {
+  static const int Block = 16;
+  const box_list* boxes;
+  int axis;
+  // boxes sorted by lower bound on axis, and these lower bounds
+  vector<int> order;
+  vector<bound_type> lower;
+  vector<bound_type> block_upper;
+  vector<double> block_best;
+
+  dp_index(const box_list& b) : boxes(&b), axis(0) {
+    int n = b.size();
+    if (n == 0 || b.k == 0){
+      return;
+    }
+    axis = most_bounded_axis(b);
+    order.resize(n);
+    for (int j=0; j<n; j++){
+      order[j] = j;
+    }
+    sort(order.begin(), order.end(), [&](int x, int y){ return b.box(x)[axis].lower < b.box(y)[axis].lower; });
+    lower.resize(n);
+    for (int j=0; j<n; j++){
+      lower[j] = b.box(order[j])[axis].lower;
+    }
+    for (int start=0; start<n; start+=Block){
+      bound_type up = -numeric_limits<bound_type>::max();
+      double best = b.value[order[start]];
+      for (int j=start; j<min(n, start+Block); j++){
+        up = max(up, b.box(order[j])[axis].upper);
+        best = Objective::better(best, b.value[order[j]]);
+      }
+      block_upper.push_back(up);
+      block_best.push_back(best);
+    }
+  }
+
+  // best of v + value over the boxes overlapping q, node_best if there is none
+  double best(const Interval* q, double v, double node_best, perf_counters* perf = NULL) const {
+    const box_list& b = *boxes;
+    if (b.k == 0){
+      for (int j=0; j<b.size(); j++){
+        node_best = Objective::better(node_best, v + b.value[j]);
+      }
+      return node_best;
+    }
+    // boxes with lower bound >= q's upper bound on axis cannot overlap q
+    int end = lower_bound(lower.begin(), lower.end(), q[axis].upper) - lower.begin();
+    for (int start=0, blk=0; start<end; start+=Block, blk++){
+      if (block_upper[blk] <= q[axis].lower){
+        continue;
+      }
+      if (!Objective::improves(v + block_best[blk], node_best)){
+        continue;
+      }
+      for (int j=start; j<min(end, start+Block); j++){
+        int m = order[j];
+        double cand = v + b.value[m];
+        if (!Objective::improves(cand, node_best)){
+          continue;
+        }
+        PERF(if (perf) perf->dp_pair_checks++);
+        if (dense_box_overlap(q, b.box(m), b.k)){
+          node_best = cand;
+        }
+      }
+    }
+    return node_best;
+  }
+};
+
+
+// bounds of the leaves of one tree, feature-major for linf_dist; kept in double, so distances are
+// the ones point_box_dist_norm computes
+struct leaf_bounds {
+  int k;
+  size_t n;
+  // leaves padded to a multiple of 8 with unconstrained boxes
+  size_t stride;
+  vector<double> lower;
+  vector<double> upper;
+
+  leaf_bounds() : k(0), n(0), stride(0) {}
+
+  leaf_bounds(const box_list& leaves) : k(leaves.k), n(leaves.size()) {
+    stride = (n + 7) / 8 * 8;
+    lower.assign(k * stride, -numeric_limits<float>::max());
+    upper.assign(k * stride, numeric_limits<float>::max());
+    for (size_t j=0; j<n; j++){
+      const Interval* b = leaves.box(j);
+      for (int d=0; d<k; d++){
+        lower[d * stride + j] = double(b[d].lower);
+        upper[d * stride + j] = double(b[d].upper);
+      }
+    }
+  }
+
+  // the box of leaf j, as it was in the box_list
+  void box(size_t j, Interval* b) const {
+    for (int d=0; d<k; d++){
+      b[d].lower = bound_type(lower[d * stride + j]);
+      b[d].upper = bound_type(upper[d * stride + j]);
+    }
+  }
+
+  // linf distance from the projected point xd to every leaf, only_dense >= 0 perturbs only that feature
+  void distances(const vector<double>& xd, bool one_attr, int only_dense, vector<double>& dist) const {
+    dist.resize(stride);
+    if (!one_attr){
+      linf_dist(xd.data(), k, lower.data(), upper.data(), stride, stride, dist.data());
+      return;
+    }
+    // a leaf that needs another feature perturbed is unreachable
+    dist.assign(stride, 0.0);
+    for (int d=0; d<k; d++){
+      for (size_t j=0; j<n; j++){
+        double gap = max(0.0, max(lower[d * stride + j] - xd[d], xd[d] - upper[d * stride + j]));
+        if (d != only_dense && gap > 0){
+          dist[j] = std::numeric_limits<double>::max();
+        }
+        else {
+          dist[j] = max(dist[j], gap);
+        }
+      }
+    }
+  }
+};
+
+
+vector<box_list> find_reachable_leaves_dense(const vector<vector<double>>& dist, const vector<box_list>& trees, const vector<leaf_bounds>& bounds, double eps, int label, int neg_label, int num_classes, perf_counters* perf = NULL){
+  // dist[i][j] is the distance from the point to leaf j of tree i, see leaf_bounds::distances
+  // trees[i] has the values, labels and ids of the leaves of tree i and bounds[i] their boxes, so
+  // the boxes of trees may have been released
+  // if neg_label < 0 assume binary model, all trees are used
+  vector<Interval> b;
+  vector<box_list> reachable;
+  if (num_classes > 2 && label == neg_label && neg_label>=0)
+      throw invalid_argument("multi-class model's target label and original label cannot be the same!");
+  for (int i=0; i<trees.size(); i++){
+    if (num_classes <= 2 || neg_label < 0 || ((i % num_classes) == label) || ((i % num_classes) == neg_label)){
+      const box_list& tree = trees[i];
+      reachable.push_back(box_list(tree.k));
+      box_list& one_tree = reachable.back();
+      b.resize(tree.k);
+      for (int j=0; j<tree.size(); j++){
+        if (dist[i][j] <= eps){
+          bounds[i].box(j, b.data());
+          one_tree.push_back(b.data(), tree.value[j], tree.label[j], tree.id[j]);
+        }
+      }
+      if (one_tree.size() < 1)
+        throw invalid_argument("number of reachable leaves less than 1, error!");
+      PERF(if (perf) perf->at(perf->reachable_leaves, i) += one_tree.size());
+    }
+  }
+  return reachable;
+}
+
+
+// how find_k_partite_clique_dense pairs the cliques found so far with the leaves of the next tree
+enum join_method { JOIN_AUTO = -1, JOIN_NESTED = 0, JOIN_SWEEP = 1 };
+
+// JOIN_AUTO sweeps joins of at least SweepMinPairs pairs when at most SweepMaxOverlap of the pairs
+// overlap on the sweep axis, estimated on SweepSample boxes of each side
+const size_t SweepMinPairs = 16384;
+const double SweepMaxOverlap = 0.5;
+const int SweepSample = 32;
+
+
+// the feature on which the fewest sampled pairs of boxes of a and b overlap, and the share of them that do
+int sweep_axis(const box_list& a, const box_list& b, double* overlap){
+  int na = min(int(a.size()), SweepSample);
+  int nb = min(int(b.size()), SweepSample);
+  int best_axis = 0;
+  int best_count = na * nb + 1;
+  for (int d=0; d<a.k; d++){
+    int count = 0;
+    for (int i=0; i<na; i++){
+      const Interval& x = a.box(size_t(i) * a.size() / na)[d];
+      for (int j=0; j<nb; j++){
+        const Interval& y = b.box(size_t(j) * b.size() / nb)[d];
+        count += max(x.lower, y.lower) < min(x.upper, y.upper);
+      }
+    }
+    if (count < best_count){
+      best_count = count;
+      best_axis = d;
+    }
+  }
+  *overlap = (na * nb > 0) ? double(best_count) / (na * nb) : 1.0;
+  return best_axis;
+}
+
+
+// value of leaf m of group, negated if its class is neg_label; Negate is false unless the model is
+// multiclass and the search is at level 0, so binary kernels carry no test
+template<bool Negate>
+inline double dense_leaf_value(const box_list& group, int m, int neg_label){
+  return (Negate && group.label[m] == neg_label) ? -group.value[m] : group.value[m];
+}
+
+
+// every intersecting pair of a clique in cliques and a leaf of group, testing all pairs; returns the pairs tested
+template<bool Negate>
+size_t nested_join(const box_list& cliques, const box_list& group, int neg_label, box_list& out, vector<Interval>& intersection){
+  int k = group.k;
+  for (int j=0; j < cliques.size(); j++){
+    for (int m=0; m < group.size(); m++){
+      if (dense_box_intersec(group.box(m), cliques.box(j), intersection.data(), k)){
+        out.push_back(intersection.data(), dense_leaf_value<Negate>(group, m, neg_label) + cliques.value[j]);
+      }
+    }
+  }
+  return cliques.size() * group.size();
+}
+
+
+// the pairs of nested_join, possibly in another order: both sides are sorted by lower bound on feature
+// axis and swept, keeping the boxes still open on that feature, so only pairs that overlap on it
+// are tested on every feature; returns the pairs tested
+template<bool Negate>
+size_t sweep_join(const box_list& cliques, const box_list& group, int axis, int neg_label, box_list& out, vector<Interval>& intersection){
+  int k = group.k;
+  vector<int> a_order(cliques.size()), b_order(group.size());
+  for (int j=0; j<a_order.size(); j++){
+    a_order[j] = j;
+  }
+  for (int m=0; m<b_order.size(); m++){
+    b_order[m] = m;
+  }
+  sort(a_order.begin(), a_order.end(), [&](int x, int y){ return cliques.box(x)[axis].lower < cliques.box(y)[axis].lower; });
+  sort(b_order.begin(), b_order.end(), [&](int x, int y){ return group.box(x)[axis].lower < group.box(y)[axis].lower; });
+  vector<int> a_open, b_open;
+  size_t tested = 0;
+  size_t ia = 0, ib = 0;
+  while (ia < a_order.size() || ib < b_order.size()){
+    // the next box to open is the one with the smallest lower bound; it overlaps, on axis, every open box
+    // of the other side whose upper bound is above its lower bound
+    bool from_a = (ib == b_order.size()) || (ia < a_order.size() && cliques.box(a_order[ia])[axis].lower <= group.box(b_order[ib])[axis].lower);
+    int n = from_a ? a_order[ia++] : b_order[ib++];
+    const Interval* box = from_a ? cliques.box(n) : group.box(n);
+    vector<int>& other_open = from_a ? b_open : a_open;
+    const box_list& other = from_a ? group : cliques;
+    size_t kept = 0;
+    for (size_t o=0; o<other_open.size(); o++){
+      int m = other_open[o];
+      if (other.box(m)[axis].upper <= box[axis].lower){
+        // closed for every box opened from now on
+        continue;
+      }
+      other_open[kept++] = m;
+      tested++;
+      int j = from_a ? n : m;
+      int leaf = from_a ? m : n;
+      if (dense_box_intersec(group.box(leaf), cliques.box(j), intersection.data(), k)){
+        out.push_back(intersection.data(), dense_leaf_value<Negate>(group, leaf, neg_label) + cliques.value[j]);
+      }
+    }
+    other_open.resize(kept);
+    (from_a ? a_open : b_open).push_back(n);
+  }
+  return tested;
+}
+
+
+// Cliques of a group of a fixed number of trees, enumerated depth first with one loop per tree after
+// the first, unrolled by the compiler. Only complete cliques are stored, in the order the chain of
+// nested_join gives, with the same values; scratch holds the box of the partial clique at each depth.
+template<bool Negate, int Depth>
+struct unrolled_clique {
+  static void extend(const box_list* trees, int neg_label, const Interval* box, double value, Interval* scratch, size_t& tested, box_list& out){
+    const box_list& tree = trees[0];
+    tested += tree.size();
+    for (int m=0; m < tree.size(); m++){
+      if (dense_box_intersec(tree.box(m), box, scratch, tree.k)){
+        unrolled_clique<Negate, Depth-1>::extend(trees + 1, neg_label, scratch, dense_leaf_value<Negate>(tree, m, neg_label) + value, scratch + tree.k, tested, out);
+      }
+    }
+  }
+};
+
+template<bool Negate>
+struct unrolled_clique<Negate, 0> {
+  static void extend(const box_list* trees, int neg_label, const Interval* box, double value, Interval* scratch, size_t& tested, box_list& out){
+    out.push_back(box, value);
+  }
+};
+
+
+// every clique of trees[0] .. trees[Size-1]; returns the pairs tested
+template<bool Negate, int Size>
+size_t unrolled_group(const box_list* trees, int neg_label, box_list& out, vector<Interval>& scratch){
+  const box_list& first = trees[0];
+  scratch.resize(Size * first.k);
+  size_t tested = 0;
+  for (int m=0; m < first.size(); m++){
+    unrolled_clique<Negate, Size-1>::extend(trees + 1, neg_label, first.box(m), dense_leaf_value<Negate>(first, m, neg_label), scratch.data(), tested, out);
+  }
+  return tested;
+}
+
+
+// true if the group of size trees from groups[start] is enumerated by unrolled_group: sizes 2 to 4 unless
+// the sweep is asked for, or, for JOIN_AUTO, unless the group is large and its first two trees are
+// told apart on one feature, which is when joins are swept
+bool use_unrolled(const vector<box_list>& groups, int start, int size, int join){
+  if (size < 2 || size > 4 || join == JOIN_SWEEP || groups[start].k == 0){
+    return false;
+  }
+  if (join == JOIN_NESTED){
+    return true;
+  }
+  double pairs = 1;
+  for (int t=start; t<start+size; t++){
+    pairs *= groups[t].size();
+  }
+  if (pairs < SweepMinPairs){
+    return true;
+  }
+  double overlap;
+  sweep_axis(groups[start], groups[start+1], &overlap);
+  return overlap > SweepMaxOverlap;
+}
+
+
+// Cliques of level 0 groups shared by every point and thread. The cliques of a group only depend on the
+// leaves reachable on each of its trees, so points in the same region, and eps steps of one point that
+// reach the same leaves, find them again; the key holds the leaf ids of every tree of the group, with
+// the objective and the classes of a multiclass search, and is compared in full, so a hash collision is only a miss.
+// Entries hold the best score of the group, and its cliques when DP or a later level needs them; the
+// least recently used ones are dropped once their estimated size exceeds capacity bytes.
+struct clique_cache {
+  struct entry {
+    vector<int> key;
+    double best;
+    bool has_cliques;
+    box_list cliques;
+  };
+  typedef std::list<std::shared_ptr<const entry>> lru_list;
+
+  size_t capacity;
+  size_t bytes;
+  uint64_t hits;
+  uint64_t misses;
+  boost::mutex mux;
+  // most recently used first
+  lru_list lru;
+  std::unordered_map<uint64_t, lru_list::iterator> by_hash;
+
+  explicit clique_cache(size_t capacity) : capacity(capacity), bytes(0), hits(0), misses(0) {}
+
+  // label and neg_label are -1 unless the groups are the trees of these two classes of a multiclass model
+  static void make_key(const vector<box_list>& groups, int start, int size, int sign, int label, int neg_label, vector<int>& key){
+    key.clear();
+    key.push_back(start);
+    key.push_back(sign);
+    key.push_back(label);
+    key.push_back(neg_label);
+    for (int t=start; t<start+size; t++){
+      key.push_back(groups[t].size());
+      key.insert(key.end(), groups[t].id.begin(), groups[t].id.end());
+    }
+  }
+
+  static uint64_t hash(const vector<int>& key){
+    // FNV-1a over the ids
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i=0; i<key.size(); i++){
+      h = (h ^ uint32_t(key[i])) * 1099511628211ULL;
+    }
+    return h;
+  }
+
+  static size_t entry_bytes(const entry& e){
+    return sizeof(entry) + e.key.size() * sizeof(int) + e.cliques.bytes();
+  }
+
+  // the entry of key, NULL if there is none or it lacks the cliques asked for
+  std::shared_ptr<const entry> find(const vector<int>& key, bool need_cliques){
+    uint64_t h = hash(key);
+    boost::lock_guard<boost::mutex> lock(mux);
+    auto it = by_hash.find(h);
+    if (it == by_hash.end() || (*it->second)->key != key || (need_cliques && !(*it->second)->has_cliques)){
+      misses++;
+      return std::shared_ptr<const entry>();
+    }
+    hits++;
+    lru.splice(lru.begin(), lru, it->second);
+    return *it->second;
+  }
+
+  // store the best score of key, and its cliques unless cliques is NULL
+  void insert(const vector<int>& key, double best, const box_list* cliques){
+    std::shared_ptr<entry> e = std::make_shared<entry>();
+    e->key = key;
+    e->best = best;
+    e->has_cliques = (cliques != NULL);
+    if (cliques){
+      e->cliques = *cliques;
+    }
+    size_t e_bytes = entry_bytes(*e);
+    if (e_bytes > capacity){
+      return;
+    }
+    uint64_t h = hash(key);
+    boost::lock_guard<boost::mutex> lock(mux);
+    auto it = by_hash.find(h);
+    if (it != by_hash.end()){
+      bytes -= entry_bytes(**it->second);
+      lru.erase(it->second);
+      by_hash.erase(it);
+    }
+    lru.push_front(e);
+    by_hash[h] = lru.begin();
+    bytes += e_bytes;
+    while (bytes > capacity){
+      const entry& last = *lru.back();
+      bytes -= entry_bytes(last);
+      by_hash.erase(hash(last.key));
+      lru.pop_back();
+    }
+  }
+};
+
+
+// find_k_partite_clique_dense for one objective and negation
+template<class Objective, bool Negate>
+tuple<vector<box_list>, double> find_k_partite_clique_kernel(const vector<box_list>& groups, int max_clique, int label, int neg_label, bool dp, int join, perf_counters* perf, int level, clique_cache* cache, bool last_level){
+  int k = groups.empty() ? 0 : groups[0].k;
+  vector<box_list> new_nodes_array;
+  box_list DP_buffer[2] = {box_list(k), box_list(k)};
+  int dp_buf_idx = 0;
+  box_list* DP_best_old = &DP_buffer[0];
+  box_list* DP_best_new = &DP_buffer[1];
+  vector<double> best_scores;
+  vector<Interval> intersection(k);
+  // only leaves have ids, so only level 0 is cached
+  bool use_cache = cache && level == 0;
+  bool need_cliques = dp || !last_level;
+  vector<int> key;
+
+  for (int start_tree=0; start_tree < groups.size(); start_tree = start_tree+max_clique){
+    box_list buffer[2] = {box_list(k), box_list(k)};
+    box_list* LL_old = &buffer[0];
+    box_list* LL_new = &buffer[1];
+    int buf_idx = 0;
+    int size = min(int(groups.size()), start_tree+max_clique) - start_tree;
+    double best_score = 0;
+
+    PERF_CLOCK(group_start);
+    std::shared_ptr<const clique_cache::entry> cached;
+    if (use_cache){
+      clique_cache::make_key(groups, start_tree, size, Objective::sign, Negate ? label : -1, Negate ? neg_label : -1, key);
+      cached = cache->find(key, need_cliques);
+      PERF(if (perf) (cached ? perf->clique_cache_hits : perf->clique_cache_misses)++);
+    }
+    if (cached){
+      if (need_cliques){
+        *LL_old = cached->cliques;
+      }
+      best_score = cached->best;
+    }
+    else if (use_unrolled(groups, start_tree, size, join)){
+      PERF_KEEP(size_t tested =) (size == 2) ? unrolled_group<Negate, 2>(&groups[start_tree], neg_label, *LL_old, intersection)
+                    : (size == 3) ? unrolled_group<Negate, 3>(&groups[start_tree], neg_label, *LL_old, intersection)
+                    : unrolled_group<Negate, 4>(&groups[start_tree], neg_label, *LL_old, intersection);
+      PERF(if (perf) {
+        perf->at(perf->intersections_tried, level, start_tree / max_clique) += tested;
+        perf->at(perf->intersections_found, level, start_tree / max_clique) += LL_old->size();
+        perf->peak_cliques = max(perf->peak_cliques, uint64_t(LL_old->size()));
+        perf->peak_clique_bytes = max(perf->peak_clique_bytes, uint64_t(LL_old->bytes()));
+      });
+    }
+    else {
+      const box_list& first = groups[start_tree];
+      for (int m=0; m < first.size(); m++){
+        LL_old->push_back(first.box(m), dense_leaf_value<Negate>(first, m, neg_label));
+      }
+
+      for (int t=start_tree+1; t < start_tree+size; t++){
+        const box_list& group = groups[t];
+        LL_new->clear();
+        int axis = -1;
+        if (k > 0 && (join == JOIN_SWEEP || (join == JOIN_AUTO && LL_old->size() * group.size() >= SweepMinPairs))){
+          double overlap;
+          axis = sweep_axis(*LL_old, group, &overlap);
+          if (join == JOIN_AUTO && overlap > SweepMaxOverlap){
+            axis = -1;
+          }
+        }
+        PERF_KEEP(size_t tested =) (axis >= 0) ? sweep_join<Negate>(*LL_old, group, axis, neg_label, *LL_new, intersection) : nested_join<Negate>(*LL_old, group, neg_label, *LL_new, intersection);
+        PERF(if (perf) {
+          perf->at(perf->intersections_tried, level, start_tree / max_clique) += tested;
+          perf->at(perf->intersections_found, level, start_tree / max_clique) += LL_new->size();
+          perf->peak_cliques = max(perf->peak_cliques, uint64_t(LL_new->size()));
+          perf->peak_clique_bytes = max(perf->peak_clique_bytes, uint64_t(LL_new->bytes()));
+        });
+        // swap two buffers, avoids copy
+        LL_old = &buffer[(++buf_idx) & 1];
+        LL_new = &buffer[(buf_idx+1) & 1];
+      }
+    }
+    if (!cached){
+      for (int i=0; i<LL_old->size(); i++){
+        best_score = (i == 0) ? LL_old->value[i] : Objective::better(best_score, LL_old->value[i]);
+      }
+      if (use_cache){
+        cache->insert(key, best_score, need_cliques ? LL_old : NULL);
+      }
+    }
+    PERF(if (perf) perf->at(perf->group_us, level, start_tree / max_clique) += PERF_US_SINCE(group_start));
+    if (dp){
+      if (start_tree==0){
+        *DP_best_old = *LL_old;
+      }
+      else{
+        DP_best_new->clear();
+        dp_index<Objective> index(*DP_best_old);
+        for (int i=0; i<LL_old->size(); i++){
+          double node_best = index.best(LL_old->box(i), LL_old->value[i], Objective::worst(), perf);
+          DP_best_new->push_back(LL_old->box(i), node_best);
+        }
+        DP_best_old = &DP_buffer[(++dp_buf_idx) & 1];
+        DP_best_new = &DP_buffer[(dp_buf_idx+1) & 1];
+      }
+    }
+    best_scores.push_back(best_score);
+    // the cliques are the leaves of the next level
+    new_nodes_array.push_back(std::move(*LL_old));
+  }
+
+  double sum_best;
+  if (dp){
+    sum_best = Objective::worst();
+    for (int j=0; j<DP_best_old->size(); j++){
+      sum_best = Objective::better(sum_best, DP_best_old->value[j]);
+    }
+  }
+  else{
+    sum_best = 0;
+    for (int i=0; i<best_scores.size(); i++){
+      sum_best = sum_best + best_scores[i];
+    }
+  }
+  return make_tuple(std::move(new_nodes_array), sum_best);
+}
+
+
+tuple<vector<box_list>, double> find_k_partite_clique_dense(const vector<box_list>& groups, int max_clique, int label, int neg_label, int num_classes, bool dp, int join = JOIN_AUTO, perf_counters* perf = NULL, int level = 0, clique_cache* cache = NULL, bool last_level = false){
+  // same as find_k_partite_clique: label is the point's true label, leaves of class neg_label are
+  // subtracted (multiclass only), dp combines the groups by dynamic programming instead of summing their best;
+  // join picks nested_join or sweep_join, the cliques found are the same, only their order may differ.
+  // With cache, level 0 groups are looked up first; on the last level without dp, the cliques returned
+  // for groups found in the cache are empty, since only the scores are used.
+  // The objective and the negation are fixed for the whole search, so the kernel is picked once here.
+  if (label<0.5 && num_classes<=2){
+    return find_k_partite_clique_kernel<maximize_score, false>(groups, max_clique, label, neg_label, dp, join, perf, level, cache, last_level);
+  }
+  if (num_classes>2 && neg_label>=0){
+    return find_k_partite_clique_kernel<minimize_score, true>(groups, max_clique, label, neg_label, dp, join, perf, level, cache, last_level);
+  }
+  return find_k_partite_clique_kernel<minimize_score, false>(groups, max_clique, label, neg_label, dp, join, perf, level, cache, last_level);
+}
+
+
+vector<double> find_multi_level_best_score_dense(const vector<vector<double>>& dist, int label, int neg_label, const vector<box_list>& trees, const vector<leaf_bounds>& bounds, int num_classes, int max_level, double eps, int max_clique, bool must_use_dp, int join = JOIN_AUTO, stage_times* times = NULL, perf_counters* perf = NULL, clique_cache* cache = NULL){
+  // same as find_multi_level_best_score, given the distances from the point to every leaf
+  high_resolution_clock::time_point t1 = high_resolution_clock::now();
+  vector<box_list> new_nodes_array = find_reachable_leaves_dense(dist, trees, bounds, eps, label, neg_label, num_classes, perf);
+  high_resolution_clock::time_point t2 = high_resolution_clock::now();
+
+  if (log_level() >= LOG_DEBUG){
+    cout << "number of reachable leaves on each tree:" << '\n';
+    for (int i=0; i<new_nodes_array.size(); i++){
+      cout << new_nodes_array[i].size() << '\n';
+      for (int j=0; j<new_nodes_array[i].size(); j++){
+        cout << ", " << new_nodes_array[i].id[j];
+      }
+      cout << '\n';
+    }
+    cout << '\n';
+  }
+
+  vector<double> sum_best;
+  for (int l=0; l<max_level; l++){
+    TV_LOG(LOG_DEBUG) << "\n\n[level " << l << " starts]\n\n";
+    bool use_dp = (l==max_level-1) && must_use_dp;
+    PERF_CLOCK(level_start);
+    tuple<vector<box_list>, double> res = find_k_partite_clique_dense(new_nodes_array, max_clique, label, (num_classes > 2 && l == 0) ? neg_label : -1, num_classes, use_dp, join, perf, l, cache, l == max_level-1);
+    PERF(if (perf) perf->at(perf->level_us, l) += PERF_US_SINCE(level_start));
+    sum_best.push_back(get<1>(res));
+    new_nodes_array = std::move(get<0>(res));
+    if (new_nodes_array.size() <= 1){
+      break;
+    }
+  }
+  if (times){
+    high_resolution_clock::time_point t3 = high_resolution_clock::now();
+    times->reach += duration_cast<nanoseconds>(t2 - t1).count() / 1000.0;
+    times->clique += duration_cast<nanoseconds>(t3 - t2).count() / 1000.0;
+  }
+  return sum_best;
+}
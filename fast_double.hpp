@@ -0,0 +1,188 @@
+/* Correctly rounded decimal to double conversion working directly on a buffer */
+
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <limits>
+#include <string>
+
+#ifndef likely
+#define likely(x)      __builtin_expect(!!(x), 1)
+#define unlikely(x)    __builtin_expect(!!(x), 0)
+#endif
+
+/*!brief powers of ten that are exact in double */
+static const double exact_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/*!brief powers of ten that are exact in x87 extended precision (5^27 < 2^64) */
+static const long double exact_pow10_ext[] = {
+    1e0L, 1e1L, 1e2L, 1e3L, 1e4L, 1e5L, 1e6L, 1e7L, 1e8L, 1e9L, 1e10L, 1e11L, 1e12L, 1e13L,
+    1e14L, 1e15L, 1e16L, 1e17L, 1e18L, 1e19L, 1e20L, 1e21L, 1e22L, 1e23L, 1e24L, 1e25L, 1e26L, 1e27L
+};
+
+/*!brief true if all 8 bytes of chunk are ASCII digits */
+inline bool is_eight_digits(uint64_t chunk) {
+    return (((chunk & 0xF0F0F0F0F0F0F0F0ULL) | (((chunk + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) == 0x3333333333333333ULL);
+}
+
+/*!brief value of 8 ASCII digits loaded little endian, combined pairwise with multiplies (SWAR) */
+inline uint32_t parse_eight_digits(uint64_t chunk) {
+    const uint64_t mask = 0x000000FF000000FFULL;
+    const uint64_t mul1 = 0x000F424000000064ULL; // 100 + (1000000 << 32)
+    const uint64_t mul2 = 0x0000271000000001ULL; // 1 + (10000 << 32)
+    chunk -= 0x3030303030303030ULL;
+    chunk = (chunk * 10) + (chunk >> 8);
+    chunk = (((chunk & mask) * mul1) + (((chunk >> 16) & mask) * mul2)) >> 32;
+    return uint32_t(chunk);
+}
+
+/*!brief slow path: strtod on a terminated copy of the token */
+inline const char* parse_double_fallback(const char* start, const char* end, double& value) {
+    const char* stop = start;
+    while (stop < end && *stop > ' ') ++stop;
+    char small_buf[64];
+    std::string large_buf;
+    char* token;
+    size_t len = stop - start;
+    if (len < sizeof(small_buf)) {
+        memcpy(small_buf, start, len);
+        small_buf[len] = '\0';
+        token = small_buf;
+    }
+    else {
+        large_buf.assign(start, len);
+        token = &large_buf[0];
+    }
+    char* token_end;
+    value = ::strtod(token, &token_end);
+    return start + (token_end - token);
+}
+
+/*!
+ * \brief Parse a decimal number from [p, end) into the nearest double, without copying.
+ * Returns a pointer after the last character used.
+ * Up to 19 significant digits are accumulated into an integer mantissa, 8 at a time when possible.
+ * The result is exact (Clinger's fast path) when the mantissa fits in 53 bits and the power of ten
+ * is exact in double. Otherwise it is computed in 64-bit extended precision and rounded to double,
+ * which is correct unless the extended result lies on a double rounding boundary; those rare cases,
+ * as well as long mantissas, large exponents, INF and NAN, go through strtod.
+ */
+inline const char* parse_double(const char* p, const char* end, double& value) {
+    const char* start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        ++p;
+    }
+    uint64_t mantissa = 0;
+    int n_digits = 0;
+    int64_t exponent = 0;
+    /* integer part */
+    const char* digits_start = p;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (end - p >= 8 && n_digits <= 11) {
+        uint64_t chunk;
+        memcpy(&chunk, p, 8);
+        if (!is_eight_digits(chunk)) break;
+        mantissa = mantissa * 100000000 + parse_eight_digits(chunk);
+        n_digits += 8;
+        p += 8;
+    }
+#endif
+    while (p < end && (unsigned char)(*p - '0') < 10) {
+        if (likely(n_digits < 19)) {
+            mantissa = mantissa * 10 + (*p - '0');
+        }
+        ++n_digits;
+        ++p;
+    }
+    bool has_digits = (p != digits_start);
+    /* fraction part */
+    if (p < end && *p == '.') {
+        ++p;
+        const char* frac_start = p;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        while (end - p >= 8 && n_digits <= 11) {
+            uint64_t chunk;
+            memcpy(&chunk, p, 8);
+            if (!is_eight_digits(chunk)) break;
+            mantissa = mantissa * 100000000 + parse_eight_digits(chunk);
+            n_digits += 8;
+            p += 8;
+        }
+#endif
+        while (p < end && (unsigned char)(*p - '0') < 10) {
+            if (likely(n_digits < 19)) {
+                mantissa = mantissa * 10 + (*p - '0');
+            }
+            ++n_digits;
+            ++p;
+        }
+        exponent = -int64_t(p - frac_start);
+        has_digits = has_digits || (p != frac_start);
+    }
+    if (unlikely(!has_digits)) {
+        return parse_double_fallback(start, end, value);
+    }
+    /* exponent part */
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* exp_start = p;
+        ++p;
+        bool exp_negative = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            exp_negative = (*p == '-');
+            ++p;
+        }
+        if (p < end && (unsigned char)(*p - '0') < 10) {
+            int64_t exp_value = 0;
+            while (p < end && (unsigned char)(*p - '0') < 10) {
+                if (exp_value < 100000) {
+                    exp_value = exp_value * 10 + (*p - '0');
+                }
+                ++p;
+            }
+            exponent += exp_negative ? -exp_value : exp_value;
+        }
+        else {
+            /* "1e" is the number 1 followed by garbage */
+            p = exp_start;
+        }
+    }
+    if (unlikely(n_digits > 19)) {
+        return parse_double_fallback(start, end, value);
+    }
+    if (mantissa == 0) {
+        value = negative ? -0.0 : 0.0;
+        return p;
+    }
+    if (mantissa <= (uint64_t(1) << 53) && exponent >= -22 && exponent <= 22) {
+        /* both operands are exact, so one IEEE operation rounds correctly */
+        double m = double(mantissa);
+        value = exponent < 0 ? m / exact_pow10[-exponent] : m * exact_pow10[exponent];
+        value = negative ? -value : value;
+        return p;
+    }
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ && (defined(__x86_64__) || defined(__i386__))
+    if (std::numeric_limits<long double>::digits == 64 && exponent >= -27 && exponent <= 27) {
+        /* the 64-bit mantissa and the power of ten are exact, the extended result has error <= 1/2 ulp */
+        long double m = (long double)mantissa;
+        long double r = exponent < 0 ? m / exact_pow10_ext[-exponent] : m * exact_pow10_ext[exponent];
+        /* x87 extended stores the full 64-bit mantissa, explicit leading bit included, in its low 8 bytes */
+        uint64_t bits;
+        memcpy(&bits, &r, sizeof(bits));
+        /* the 11 bits dropped by double: only a result at the midpoint can round the wrong way */
+        uint64_t dropped = bits & 0x7FF;
+        if (likely(dropped < 0x3FF || dropped > 0x401)) {
+            value = double(r);
+            value = negative ? -value : value;
+            return p;
+        }
+    }
+#endif
+    return parse_double_fallback(start, end, value);
+}
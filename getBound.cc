@@ -9,8 +9,19 @@
 #include <math.h>
 #include <chrono>
 #include <random>
+#include <map>
+#include <memory>
 #include "svmreader.hpp"
-#include "tree_func.hpp"
+#include "bindata.hpp"
+#include "results.hpp"
+#include "synth.hpp"
+#include "log.hpp"
+#include "verifier.hpp"
+#include "server.hpp"
+#include "pipeline.hpp"
+#include "numa_nodes.hpp"
+#include "shard.hpp"
+#include "checkpoint.hpp"
 
 using namespace std;
 using namespace std::chrono;
@@ -19,8 +30,56 @@ using json = nlohmann::json;
 
 int main(int argc, char** argv){
 
+  if (argc < 2){
+    cerr << "usage: " << argv[0] << " <config.json> [--shard i/N [--interleave]] [--partial <file>]\n       " << argv[0] << " merge <shard.json> ...\n       " << argv[0] << " convert-data <input.libsvm> <output> [dense|csr]\n       " << argv[0] << " gen-synth <prefix> [trees=N] [depth=N] [features=N] [classes=N] [points=N] [thresholds=N] [seed=N]\n       " << argv[0] << " serve <config.json> <socket> [workers=N] [queue=N] [batch=N]\n       " << argv[0] << " client <socket> [requests.jsonl]\n";
+    return 1;
+  }
+  if (string(argv[1]) == "convert-data"){
+    return convert_data(argc, argv);
+  }
+  if (string(argv[1]) == "gen-synth"){
+    return gen_synth(argc, argv);
+  }
+  if (string(argv[1]) == "serve"){
+    return serve(argc, argv);
+  }
+  if (string(argv[1]) == "client"){
+    return serve_client(argc, argv);
+  }
+  if (string(argv[1]) == "merge"){
+    return merge_shards(argc, argv);
+  }
+
   high_resolution_clock::time_point t1 = high_resolution_clock::now();
   string config_file = string(argv[1]);
+  // --shard i/N verifies one slice of the points and writes its results to the --partial file for merge
+  string shard_text;
+  bool interleave = false;
+  string partial_file;
+  for (int i=2; i<argc; i++){
+    string arg = argv[i];
+    if (arg == "--shard" && i+1 < argc){
+      shard_text = argv[++i];
+    }
+    else if (arg == "--interleave"){
+      interleave = true;
+    }
+    else if (arg == "--partial" && i+1 < argc){
+      partial_file = argv[++i];
+    }
+    else {
+      cerr << "unknown argument " << arg << '\n';
+      return 1;
+    }
+  }
+  shard_spec shard;
+  if (!shard_text.empty()){
+    shard = shard_spec::parse(shard_text, interleave);
+    if (partial_file.empty()){
+      string stem = config_file.size() > 5 && config_file.compare(config_file.size() - 5, 5, ".json") == 0 ? config_file.substr(0, config_file.size() - 5) : config_file;
+      partial_file = stem + ".shard" + to_string(shard.index) + "of" + to_string(shard.count) + ".json";
+    }
+  }
   ifstream config(config_file);
   json param;
   config >> param;
@@ -38,6 +97,18 @@ int main(int argc, char** argv){
   bool one_attr;
   int only_attr;
   int feature_start;
+  bool project_features;
+  bool pipeline;
+  bool numa;
+  int dense_boxes;
+  int join;
+  double clique_cache;
+  int batch;
+  bool reuse_bounds;
+  int threads;
+  string results_file;
+  string counters_file;
+  string checkpoint_file;
 
   if (param.find("inputs") != param.end()){
     ori_file = param["inputs"];
@@ -103,7 +174,7 @@ int main(int argc, char** argv){
   }
 
   if (param.find("dp") != param.end()){
-    dp = bool(int(param["num_classes"]));
+    dp = bool(int(param["dp"]));
   }
   else {
     dp = false;
@@ -125,136 +196,504 @@ int main(int argc, char** argv){
     feature_start = 1;
   }
 
+  if (param.find("project_features") != param.end()){
+    project_features = bool(int(param["project_features"]));
+  }
+  else {
+    project_features = false;
+  }
+
+  if (param.find("dense_boxes") != param.end()){
+    dense_boxes = int(param["dense_boxes"]);
+  }
+  else {
+    dense_boxes = -1;
+  }
+
+  if (param.find("join") != param.end()){
+    join = int(param["join"]);
+  }
+  else {
+    join = -1;
+  }
+
+  if (param.find("clique_cache") != param.end()){
+    clique_cache = double(param["clique_cache"]);
+  }
+  else {
+    clique_cache = 0;
+  }
+
+  if (param.find("batch") != param.end()){
+    batch = max(1, int(param["batch"]));
+  }
+  else {
+    batch = PipelineBlockRows;
+  }
+
+  if (param.find("reuse_bounds") != param.end()){
+    reuse_bounds = bool(int(param["reuse_bounds"]));
+  }
+  else {
+    reuse_bounds = false;
+  }
+
+  if (param.find("pipeline") != param.end()){
+    pipeline = bool(int(param["pipeline"]));
+  }
+  else {
+    pipeline = false;
+  }
+
+  // numa places the workers of pipeline mode on the NUMA nodes, so it implies it
+  if (param.find("numa") != param.end()){
+    numa = bool(int(param["numa"]));
+  }
+  else {
+    numa = false;
+  }
+  pipeline = pipeline || numa;
+
+  if (param.find("threads") != param.end()){
+    threads = max(1, int(param["threads"]));
+  }
+  else {
+    threads = max(1u, boost::thread::hardware_concurrency());
+  }
+
+  if (param.find("verbosity") != param.end()){
+    log_level() = int(param["verbosity"]);
+  }
+
+  if (param.find("results") != param.end()){
+    results_file = param["results"];
+  }
+
+  if (param.find("checkpoint") != param.end()){
+    checkpoint_file = param["checkpoint"];
+  }
+
+  if (param.find("counters") != param.end()){
+    counters_file = param["counters"];
+#ifndef TREEVERIFY_COUNTERS
+    cerr << "warning: counters requested but treeVerify was built without TREEVERIFY_COUNTERS\n";
+#endif
+  }
+
   if (num_classes < 2) { num_classes = 2; }
-  cout << "inputs: " << ori_file << "\nmodel: "<< tree_file  << "\nstart_idx: " << start_idx << "\nnum_attack: " << num_attack << "\neps_init: " << eps_init << "\nmax_clique: " << max_clique << "\nmax_search: " << max_search << "\nmax_level: " << max_level << "\nnum_classes: " << num_classes <<"\ndp: " << dp << "\none_attr: "<< one_attr << "\nonly_attr: "<< only_attr <<'\n';
+  TV_LOG(LOG_INFO) << "inputs: " << ori_file << "\nmodel: "<< tree_file  << "\nstart_idx: " << start_idx << "\nnum_attack: " << num_attack << "\neps_init: " << eps_init << "\nmax_clique: " << max_clique << "\nmax_search: " << max_search << "\nmax_level: " << max_level << "\nnum_classes: " << num_classes <<"\ndp: " << dp << "\none_attr: "<< one_attr << "\nonly_attr: "<< only_attr << "\nproject_features: " << project_features  << "\ndense_boxes: " << dense_boxes << "\njoin: " << join << "\nclique_cache: " << clique_cache << "\nbatch: " << batch << "\nreuse_bounds: " << reuse_bounds << "\npipeline: " << pipeline << "\nnuma: " << numa << "\nthreads: " << threads << "\nresults: " << results_file << "\ncounters: " << counters_file << "\ncheckpoint: " << checkpoint_file <<'\n';
   
   
-  cout << "\nfeature starts at "<< feature_start << "\n";
-  
+  TV_LOG(LOG_INFO) << "\nfeature starts at "<< feature_start << "\n";
 
-  // read data inputs 
-  vector<vector<double>> ori_X;
-  vector<int> ori_y;  
-  read_libsvm(ori_file, ori_X, ori_y, num_classes<=2);
-  
-  ifstream tree_data(tree_file);
-  json model;
-  tree_data >> model;  
-   
-  vector<vector<Leaf>> all_tree_leaves;
-  vector<Leaf> one_tree_leaves; 
+  json shard_info = shard_header(shard, param, start_idx, num_attack, eps_init);
+  json shard_points = json::array();
+  shard.slice(start_idx, num_attack);
+  if (!shard_text.empty()){
+    TV_LOG(LOG_INFO) << "shard " << shard.index << " of " << shard.count << (shard.interleaved ? ", interleaved" : "") << ": points " << start_idx << " to " << start_idx + num_attack - 1 << ", results in " << partial_file << "\n";
+  }
   
-  //calculate and print leave bounds
-  for (int i=0; i<model.size(); i++){
-    interval_map<int,Interval> no_constr;
-    no_constr.clear();
-    one_tree_leaves.clear();
-    int class_label;
-    if (num_classes==2)
-      class_label = -1;
-    else
-      class_label = i % num_classes;
-    dfs(model[i], i, no_constr, one_tree_leaves, class_label);
-    all_tree_leaves.push_back(one_tree_leaves);
-    cout <<"\n\n" << i <<"th tree\n";
-    
-  } 
-
-  high_resolution_clock::time_point t5 = high_resolution_clock::now(); 
+
+  treeverify::verifier_options options;
+  options.num_classes = num_classes;
+  options.max_clique = max_clique;
+  options.max_level = max_level;
+  options.max_search = max_search;
+  options.eps_init = eps_init;
+  options.feature_start = feature_start;
+  options.dp = dp;
+  options.only_attr = only_attr;
+  options.dense_boxes = dense_boxes;
+  options.join = join;
+  options.clique_cache = clique_cache;
+
+  // points finished by an earlier run of the same config and model are read back instead of verified
+  checkpoint_log checkpoint;
+  if (!checkpoint_file.empty()){
+    json checkpoint_header = shard_info;
+    checkpoint_header["model_hash"] = file_hash(tree_file);
+    checkpoint.open(checkpoint_file, checkpoint_header);
+    TV_LOG(LOG_INFO) << "checkpoint: " << checkpoint.finished().size() << " points finished by an earlier run\n";
+  }
+
+  result_writer results;
+  if (!results_file.empty()){
+    results.open(results_file);
+  }
+
   double avg_bound = 0;
-  num_attack = min(int(ori_X.size())-start_idx, num_attack);
-  cout << "number of points: "<< num_attack  << '\n';
   int n_initial_success = 0;
-  for (int n=start_idx; n<num_attack+start_idx; n++){ //loop all points
-    cout << "\n\n\n\n=================start index:" << start_idx << ", num of points:" << num_attack << ", current index:" << n << ", current label: "<< ori_y[n]  <<" =================\n";
-    double eps = eps_init;
-    high_resolution_clock::time_point t3 = high_resolution_clock::now();
-    vector<bool> rob_log;
-    vector<double> eps_log;
-    int last_rob = -1;
-    int last_unrob = -1;
-    for (int search_step=0; search_step<max_search; search_step++){
-      cout << "\n\n************** eps=" << eps << " starts ******************\n";
-      
-      bool robust = true;
-      if (num_classes <= 2){ 
-        cout << "\n^^^^^^^^^^^^^^^^ binary model  ^^^^^^^^^^^^^^^\n";
-        vector<double> sum_best = find_multi_level_best_score(ori_X[n], ori_y[n], -1, all_tree_leaves, num_classes, max_level, eps, max_clique, feature_start, one_attr, only_attr, dp); 
-        
-        robust = (ori_y[n]<0.5&&sum_best.back()<0)||(ori_y[n]>0.5&&sum_best.back()>0);
+  int n_points = 0;
+  // points whose search was skipped, or started from a reused bound
+  int n_reuse_skipped = 0;
+  int n_reuse_seeded = 0;
+  treeverify::cache_stats cache;
+  perf_counters run_perf;
+  // print, record and add up the result of point n, points are reported in index order;
+  // resumed points come from the checkpoint and are not written to it again
+  auto report_point = [&](int n, int y, const treeverify::bound_result& res, long long point_duration, perf_counters& point_perf, bool resumed){
+    n_points++;
+    if (res.initially_robust) {
+      n_initial_success += 1;
+    }
+    if (res.reused > 0){
+      (res.eps.empty() ? n_reuse_skipped : n_reuse_seeded) += 1;
+    }
+    double clique_bound = res.bound;
+    avg_bound = avg_bound + clique_bound;
+    if (clique_bound <= 0){
+      TV_LOG(LOG_INFO) << "\npoint "<< n << ": WARNING! no robust eps found, verification bound is set as 0 !!!!!!!!\n";
+    }
+    TV_LOG(LOG_INFO) << "=============================== end of point "<< n  <<", running time: " << point_duration  <<" microseconds, clique res: " << clique_bound << " ====================================" <<'\n';
+    if (results.is_open() || (checkpoint.is_open() && !resumed)){
+      json record;
+      record["index"] = n;
+      record["label"] = y;
+      record["bound"] = clique_bound;
+      record["eps"] = res.eps;
+      record["robust"] = res.robust;
+      if (res.reused > 0){
+        record["reused"] = res.reused;
       }
-      else{
-        cout << "\n^^^^^^^^^^^^^^^^ " << num_classes  << "  classes model  ^^^^^^^^^^^^^^^\n";
-        for (int neg_label=0; neg_label<num_classes; neg_label++){
-          if (neg_label != ori_y[n]){
-            cout << "\n^^^^^^^^^^^^^^^^ original class: " << ori_y[n]  << " target class: " << neg_label << " starts ^^^^^^^^^^^^^^^\n";
-            vector<double> sum_best = find_multi_level_best_score(ori_X[n], ori_y[n], neg_label, all_tree_leaves, num_classes, max_level, eps, max_clique, feature_start, one_attr, only_attr, dp);
-            cout << "\n best score for each level:\t";
-            for (int i=0;i<sum_best.size(); i++){
-              cout << sum_best[i] <<'\t'; 
-            }
-            
-            robust = robust && (sum_best.back()>0);
-            if (!robust){
-              break;
-            }
-          }
-        }
-      
+      record["time_us"] = {{"total", point_duration}, {"reach", res.reach_us}, {"clique", res.clique_us}};
+      if (checkpoint.is_open() && !resumed){
+        json line = record;
+        line["initially_robust"] = res.initially_robust;
+        checkpoint.append(line);
       }
-      // at the first search, evaluate the verified error 
-      if (search_step == 0 && robust) {
-        n_initial_success += 1;
+#ifdef TREEVERIFY_COUNTERS
+      if (!resumed){
+        point_perf.points = 1;
+        record["counters"] = point_perf.to_json();
       }
-      cout << "Can model be guaranteed robust within eps " << eps << "? (0 for no, 1 for yes): " << robust  <<'\n';
-      rob_log.push_back(robust);
-      eps_log.push_back(eps);
-      if (robust) {
-        last_rob = rob_log.size() - 1;
+#endif
+      if (results.is_open()){
+        results.write(record.dump());
       }
-      else {
-        last_unrob = rob_log.size() - 1;
+    }
+    if (!partial_file.empty()){
+      shard_points.push_back({{"index", n}, {"bound", clique_bound}, {"initially_robust", res.initially_robust}});
+    }
+    if (!resumed){
+      PERF(point_perf.points = 1; run_perf.add(point_perf));
+    }
+  };
+  // report the points of the checkpoint before index n, in index order with the points verified by this run
+  map<int, json>::const_iterator next_resumed = checkpoint.finished().begin();
+  auto report_resumed = [&](int n){
+    perf_counters no_perf;
+    for (; next_resumed != checkpoint.finished().end() && next_resumed->first < n; ++next_resumed){
+      const json& record = next_resumed->second;
+      treeverify::bound_result res;
+      res.bound = record["bound"];
+      res.initially_robust = record["initially_robust"];
+      res.eps = record["eps"].get<vector<double>>();
+      res.robust = record["robust"].get<vector<bool>>();
+      res.reused = record.value("reused", 0.0);
+      res.total_us = record["time_us"]["total"];
+      res.reach_us = record["time_us"]["reach"];
+      res.clique_us = record["time_us"]["clique"];
+      report_point(next_resumed->first, record["label"], res, (long long)(res.total_us), no_perf, true);
+    }
+  };
+  // with reuse_bounds, the resumed points among rows (row i is point first + i) are inserted as the earlier run
+  // did after verifying them: with their bound, when it is above the bound they reused
+  auto reuse_resumed = [&](const data_view& rows, int first, size_t min_x, treeverify::certified_bounds* reuse){
+    vector<double> x;
+    for (size_t i=0; reuse && i<rows.size(); i++){
+      map<int, json>::const_iterator it = checkpoint.finished().find(first + int(i));
+      if (it != checkpoint.finished().end() && double(it->second["bound"]) > it->second.value("reused", 0.0)){
+        rows.dense_row(i, x, feature_start, min_x);
+        reuse->insert(x, int(it->second["label"]), double(it->second["bound"]));
       }
+    }
+  };
 
-      if (last_rob<0) {
-        eps = eps * 0.5;
+  if (pipeline){
+    // the model is parsed on one thread while the first points are read on another
+    pipeline_error error;
+    // with numa, every node builds its own copy of the model on a thread bound to it, so its tables are
+    // in local memory, and its workers verify a share of the blocks; otherwise one node -1 does it all.
+    // Every node has at least one worker, so there are no more nodes than threads, and the threads are
+    // split between them in proportion to their CPUs
+    vector<int> nodes = numa ? numa_run_nodes() : vector<int>(1, -1);
+    if (int(nodes.size()) > threads){
+      nodes.resize(threads);
+    }
+    vector<int> workers_of_node = node_workers(nodes, threads);
+    vector<unique_ptr<treeverify::Verifier>> verifiers(nodes.size());
+    boost::thread_group model_loaders;
+    for (size_t k=0; k<nodes.size(); k++){
+      model_loaders.create_thread([&, k](){
+        try {
+          bind_to_node(nodes[k]);
+          verifiers[k].reset(new treeverify::Verifier(tree_file, options));
+        }
+        catch (...) {
+          error.set(current_exception());
+        }
+      });
+    }
+    // the next point of this shard from index n on that is not in the checkpoint
+    auto next_in_shard = [&](int n){
+      while (n < start_idx + num_attack && (!shard.contains(n - start_idx) || checkpoint.contains(n))){
+        n++;
       }
-      else {
-        if (last_unrob<0){ 
-          if (eps >= 1){
-            cout << "\n eps >=1, break binary search!\n";
-            break;
-          }
-          eps = min(eps * 2.0, 1.0);
+      return n;
+    };
+    // the points before the first one left to verify are all resumed or in other shards, so they are not read
+    // again, except for reuse_bounds below; the blocks start at point stream_idx
+    int stream_idx = next_in_shard(start_idx);
+    bounded_queue<point_block> blocks(PipelineQueueBlocks);
+    mapped_data ori_mapped;
+    boost::thread producer;
+    if (is_bin_data(ori_file)){
+      ori_mapped.open(ori_file);
+      producer = boost::thread(boost::bind(&produce_view_blocks, ori_mapped.view().slice(stream_idx, start_idx + num_attack - stream_idx), batch, &blocks));
+    }
+    else {
+      producer = boost::thread(boost::bind(&produce_libsvm_blocks, ori_file, stream_idx, start_idx + num_attack - stream_idx, batch, &blocks, &error));
+    }
+    model_loaders.join_all();
+    if (find(verifiers.begin(), verifiers.end(), nullptr) != verifiers.end()){
+      point_block unused;
+      while (blocks.pop(unused)) {}
+      producer.join();
+      error.rethrow();
+    }
+    const treeverify::Verifier* verifier = verifiers[0].get();
+    vector<bounded_queue<point_block>*> node_blocks(1, &blocks);
+    vector<unique_ptr<bounded_queue<point_block>>> node_queues;
+    boost::thread distributor;
+    if (nodes.size() > 1){
+      node_blocks.clear();
+      for (size_t k=0; k<nodes.size(); k++){
+        node_queues.emplace_back(new bounded_queue<point_block>(PipelineQueueBlocks));
+        node_blocks.push_back(node_queues.back().get());
+      }
+      distributor = boost::thread(boost::bind(&distribute_blocks, &blocks, node_blocks, workers_of_node));
+    }
+    // points verified by the workers of each node, and when its last block was done
+    struct node_stats {
+      int workers;
+      int points;
+      long long last_us;
+      node_memory_stats memory;
+    };
+    vector<node_stats> node_done(nodes.size());
+    for (size_t k=0; k<nodes.size(); k++){
+      node_done[k].workers = workers_of_node[k];
+      node_done[k].points = 0;
+      node_done[k].last_us = 0;
+      node_done[k].memory = node_memory_stats::read(nodes[k]);
+    }
+    high_resolution_clock::time_point workers_start = high_resolution_clock::now();
+    // x must cover every feature of the model, even if a block of points has fewer
+    size_t n_used = verifier->used_features().size();
+    size_t min_x = n_used > size_t(feature_start) ? n_used - feature_start : 0;
+    // shared by the workers, so the bounds reused depend on the order in which blocks are verified;
+    // the resumed points that are not streamed are read here and go in before any block is verified
+    unique_ptr<treeverify::certified_bounds> reuse;
+    if (reuse_bounds){
+      reuse.reset(new treeverify::certified_bounds(*verifier));
+      if (stream_idx > start_idx && !checkpoint.finished().empty()){
+        example_data resumed_data;
+        data_view resumed_view;
+        if (is_bin_data(ori_file)){
+          resumed_view = ori_mapped.view().slice(start_idx, stream_idx - start_idx);
         }
         else {
-          eps = 0.5 * (eps_log[last_rob] + eps_log[last_unrob]);
+          read_libsvm(ori_file, resumed_data, start_idx, stream_idx - start_idx);
+          resumed_view = resumed_data.view();
+        }
+        reuse_resumed(resumed_view, start_idx, min_x, reuse.get());
+      }
+    }
+    // results wait here until every point before them is reported
+    struct finished_point {
+      int y;
+      treeverify::bound_result res;
+      long long duration;
+      perf_counters perf;
+    };
+    boost::mutex report_mux;
+    map<int, finished_point> finished;
+    int next_report = stream_idx;
+    auto worker = [&](size_t node){
+      bind_to_node(nodes[node]);
+      const treeverify::Verifier* verifier = verifiers[node].get();
+      point_block block;
+      vector<vector<double>> xs;
+      vector<int> ys;
+      vector<perf_counters> perfs;
+      while (node_blocks[node]->pop(block)){
+        data_view rows = block.rows();
+        int first = stream_idx + block.first;
+        try {
+          // resumed points after stream_idx, if any, go into reuse_bounds before the rest of their block
+          reuse_resumed(rows, first, min_x, reuse.get());
+          // a block is verified as one batch, of the rows of this shard not in the checkpoint
+          vector<int> shard_rows;
+          for (size_t i=0; i<rows.size(); i++){
+            if (shard.contains(first + i - start_idx) && !checkpoint.contains(first + i)){
+              shard_rows.push_back(i);
+            }
+          }
+          xs.resize(shard_rows.size());
+          ys.resize(shard_rows.size());
+          for (size_t i=0; i<shard_rows.size(); i++){
+            rows.dense_row(shard_rows[i], xs[i], feature_start, min_x);
+            ys[i] = int(rows.y[shard_rows[i]]);
+          }
+          TV_LOG(LOG_STEPS) << "\n\n\n\n=================start index:" << start_idx << ", current indices:" << first << " to " << first + int(rows.size()) - 1 <<" =================\n";
+          vector<treeverify::bound_result> res;
+          if (!shard_rows.empty()){
+            res = verifier->max_eps(xs, ys, &perfs, reuse.get());
+          }
+          boost::lock_guard<boost::mutex> lock(report_mux);
+          node_done[node].points += int(shard_rows.size());
+          node_done[node].last_us = duration_cast<microseconds>(high_resolution_clock::now() - workers_start).count();
+          for (size_t i=0; i<shard_rows.size(); i++){
+            finished_point& point = finished[first + shard_rows[i]];
+            point.y = ys[i];
+            point.res = std::move(res[i]);
+            point.duration = (long long)(point.res.total_us);
+            point.perf = std::move(perfs[i]);
+          }
+          while (!finished.empty() && finished.begin()->first == next_report){
+            finished_point& p = finished.begin()->second;
+            report_resumed(next_report);
+            report_point(next_report, p.y, p.res, p.duration, p.perf, false);
+            finished.erase(finished.begin());
+            next_report = next_in_shard(next_report + 1);
+          }
+          if (checkpoint.is_open()){
+            checkpoint.sync();
+          }
+        }
+        catch (...) {
+          error.set(current_exception());
         }
       }
+    };
+    boost::thread_group workers;
+    for (size_t k=0; k<nodes.size(); k++){
+      for (int i=0; i<node_done[k].workers; i++){
+        workers.create_thread([&worker, k](){ worker(k); });
+      }
+    }
+    workers.join_all();
+    if (distributor.joinable()){
+      distributor.join();
+    }
+    producer.join();
+    error.rethrow();
+    report_resumed(numeric_limits<int>::max());
+    num_attack = n_points;
+    TV_LOG(LOG_INFO) << "number of points: "<< num_attack  << '\n';
+    if (numa){
+      for (size_t k=0; k<nodes.size(); k++){
+        node_memory_stats memory = node_memory_stats::read(nodes[k]);
+        double seconds = double(node_done[k].last_us)/1000000.0;
+        TV_LOG(LOG_INFO) << "node " << nodes[k] << ": " << node_done[k].workers << " workers, " << node_done[k].points << " points in " << seconds << " seconds, "
+                         << (seconds > 0 ? node_done[k].points / seconds : 0.0) << " points per second, " << memory.local - node_done[k].memory.local << " pages allocated locally, "
+                         << memory.remote - node_done[k].memory.remote << " for other nodes\n";
+      }
+    }
+    for (size_t k=0; k<verifiers.size(); k++){
+      treeverify::cache_stats node_cache = verifiers[k]->clique_cache_stats();
+      cache.hits += node_cache.hits;
+      cache.misses += node_cache.misses;
+      cache.entries += node_cache.entries;
+      cache.bytes += node_cache.bytes;
+    }
+  }
+  else {
+    treeverify::Verifier verifier(tree_file, options);
+    unique_ptr<treeverify::certified_bounds> reuse;
+    if (reuse_bounds){
+      reuse.reset(new treeverify::certified_bounds(verifier));
+    }
 
-      cout << "\n**************** this eps ends, next eps:" << eps  <<" *********************\n";
+    // read data inputs, only the points to verify and optionally only the features used by the model
+    // a binary dataset made by convert-data is mapped instead of parsed
+    example_data ori_data;
+    mapped_data ori_mapped;
+    data_view ori_view;
+    if (is_bin_data(ori_file)){
+      ori_mapped.open(ori_file);
+      ori_view = ori_mapped.view();
+      TV_LOG(LOG_INFO) << "\nmapped data shape:" << ori_view.size() << " * " << ori_view.n_feat <<'\n';
+      ori_view = ori_view.slice(start_idx, num_attack);
     }
-    
-    double clique_bound = 0;
-    if (last_rob>=0){
-      clique_bound = eps_log[last_rob];
-      avg_bound = avg_bound + clique_bound;
+    else {
+      read_libsvm(ori_file, ori_data, start_idx, num_attack, project_features ? &verifier.used_features() : NULL);
+      ori_view = ori_data.view();
     }
-    else{
-      cout<< "\npoint "<< n << ": WARNING! no robust eps found, verification bound is set as 0 !!!!!!!!\n";
+
+    num_attack = min(int(ori_view.size()), num_attack);
+    TV_LOG(LOG_INFO) << "number of points: "<< num_attack  << '\n';
+    // x must cover every feature of the model, even if the points read have fewer
+    size_t n_used = verifier.used_features().size();
+    size_t min_x = n_used > size_t(feature_start) ? n_used - feature_start : 0;
+    // resumed points come before the points left to verify, so all of them go into reuse_bounds first
+    reuse_resumed(ori_view.slice(0, num_attack), start_idx, min_x, reuse.get());
+    // the points of this shard not in the checkpoint, as offsets from start_idx
+    vector<int> rows;
+    for (int n=0; n<num_attack; n++){
+      if (shard.contains(n) && !checkpoint.contains(start_idx+n)){
+        rows.push_back(n);
+      }
     }
-    high_resolution_clock::time_point t4 = high_resolution_clock::now();
-    auto point_duration = duration_cast<microseconds>( t4 - t3).count();
-    cout << "=============================== end of point "<< n  <<", running time: " << point_duration  <<" microseconds, clique res: " << clique_bound << " ====================================" <<'\n';
+    vector<vector<double>> xs;
+    vector<int> ys;
+    vector<perf_counters> perfs;
+    for (int first=0; first<rows.size(); first+=batch){ //loop all points, a batch at a time
+      int n_batch = min(batch, int(rows.size())-first);
+      xs.resize(n_batch);
+      ys.resize(n_batch);
+      for (int i=0; i<n_batch; i++){
+        ori_view.dense_row(rows[first+i], xs[i], feature_start, min_x);
+        ys[i] = int(ori_view.y[rows[first+i]]);
+      }
+      TV_LOG(LOG_STEPS) << "\n\n\n\n=================start index:" << start_idx << ", num of points:" << num_attack << ", current indices:" << start_idx+rows[first] << " to " << start_idx+rows[first+n_batch-1] <<" =================\n";
+      vector<treeverify::bound_result> res = verifier.max_eps(xs, ys, &perfs, reuse.get());
+      for (int i=0; i<n_batch; i++){
+        report_resumed(start_idx+rows[first+i]);
+        report_point(start_idx+rows[first+i], ys[i], res[i], (long long)(res[i].total_us), perfs[i], false);
+      }
+      if (checkpoint.is_open()){
+        checkpoint.sync();
+      }
+    }
+    report_resumed(numeric_limits<int>::max());
+    num_attack = n_points;
+    cache = verifier.clique_cache_stats();
+  }
+  if (reuse_bounds){
+    TV_LOG(LOG_INFO) << "reused bounds: " << n_reuse_skipped << " searches skipped, " << n_reuse_seeded << " searches started from a reused bound\n";
+  }
+  if (clique_cache > 0){
+    TV_LOG(LOG_INFO) << "clique cache: " << cache.hits << " hits, " << cache.misses << " misses, " << cache.entries << " entries, " << cache.bytes << " bytes\n";
   }
-  double verified_err = 1.0 - n_initial_success / (double)num_attack;
-  avg_bound = avg_bound / num_attack; 
+  // a shard, or a start_idx past the last point, may have no points at all
+  double verified_err = (num_attack > 0) ? 1.0 - n_initial_success / (double)num_attack : 0;
+  avg_bound = (num_attack > 0) ? avg_bound / num_attack : 0;
   cout << "\nclique method average bound:" << avg_bound << endl;
   cout << "verified error at epsilon " << eps_init << " = " << verified_err << endl;
   high_resolution_clock::time_point t2 = high_resolution_clock::now();
   auto total_duration = duration_cast<microseconds>( t2 - t1 ).count();
   cout << " total running time: " << double(total_duration)/1000000.0 << " seconds\n";
-  cout << " per point running time: " << double(total_duration)/1000000.0/num_attack << " seconds\n";
+  if (num_attack > 0){
+    cout << " per point running time: " << double(total_duration)/1000000.0/num_attack << " seconds\n";
+  }
+  if (!partial_file.empty()){
+    write_shard(partial_file, shard_info, shard_points, double(total_duration)/1000000.0);
+  }
+  if (!counters_file.empty()){
+    ofstream counters_out(counters_file);
+    counters_out << run_perf.to_json().dump() << '\n';
+  }
   return 0;
 }
 
@@ -0,0 +1,130 @@
+#pragma once
+// L-inf distance from one point to many boxes whose bounds are stored feature-major: the bounds of
+// feature d of box j are lower[d * stride + j] and upper[d * stride + j]. Each box distance is
+// max over d of max(lower - x[d], x[d] - upper, 0), the same value point_box_dist_norm<NORM_LINF> gives.
+// The AVX2 and AVX-512 kernels are compiled with target attributes and picked at run time, so one
+// binary runs on any x86-64 CPU; TREEVERIFY_SIMD=scalar|avx2|avx512 forces a lower level.
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define TREEVERIFY_X86_SIMD
+#endif
+
+
+enum simd_level { SIMD_SCALAR = 0, SIMD_AVX2 = 1, SIMD_AVX512 = 2 };
+
+
+// distances to boxes begin..end-1
+void linf_dist_scalar(const double* x, int k, const double* lower, const double* upper, size_t stride, size_t begin, size_t end, double* dist){
+  for (size_t j=begin; j<end; j++){
+    dist[j] = 0;
+  }
+  for (int d=0; d<k; d++){
+    const double* l = lower + d * stride;
+    const double* u = upper + d * stride;
+    for (size_t j=begin; j<end; j++){
+      dist[j] = std::max(dist[j], std::max(l[j] - x[d], x[d] - u[j]));
+    }
+  }
+}
+
+
+#ifdef TREEVERIFY_X86_SIMD
+// both kernels sweep one feature at a time over all the boxes, reading each bound array sequentially
+// while the distances stay in L1, then finish the boxes that do not fill a vector with a lower level
+__attribute__((target("avx2")))
+void linf_dist_avx2(const double* x, int k, const double* lower, const double* upper, size_t stride, size_t begin, size_t end, double* dist){
+  size_t vec_end = begin + (end - begin) / 4 * 4;
+  for (size_t j=begin; j<vec_end; j+=4){
+    _mm256_storeu_pd(dist + j, _mm256_setzero_pd());
+  }
+  for (int d=0; d<k; d++){
+    const double* l = lower + d * stride;
+    const double* u = upper + d * stride;
+    __m256d xd = _mm256_set1_pd(x[d]);
+    for (size_t j=begin; j<vec_end; j+=4){
+      __m256d below = _mm256_sub_pd(_mm256_loadu_pd(l + j), xd);
+      __m256d above = _mm256_sub_pd(xd, _mm256_loadu_pd(u + j));
+      _mm256_storeu_pd(dist + j, _mm256_max_pd(_mm256_loadu_pd(dist + j), _mm256_max_pd(below, above)));
+    }
+  }
+  linf_dist_scalar(x, k, lower, upper, stride, vec_end, end, dist);
+}
+
+
+__attribute__((target("avx512f")))
+void linf_dist_avx512(const double* x, int k, const double* lower, const double* upper, size_t stride, size_t begin, size_t end, double* dist){
+  size_t vec_end = begin + (end - begin) / 8 * 8;
+  for (size_t j=begin; j<vec_end; j+=8){
+    _mm512_storeu_pd(dist + j, _mm512_setzero_pd());
+  }
+  for (int d=0; d<k; d++){
+    const double* l = lower + d * stride;
+    const double* u = upper + d * stride;
+    __m512d xd = _mm512_set1_pd(x[d]);
+    for (size_t j=begin; j<vec_end; j+=8){
+      __m512d below = _mm512_sub_pd(_mm512_loadu_pd(l + j), xd);
+      __m512d above = _mm512_sub_pd(xd, _mm512_loadu_pd(u + j));
+      _mm512_storeu_pd(dist + j, _mm512_max_pd(_mm512_loadu_pd(dist + j), _mm512_max_pd(below, above)));
+    }
+  }
+  linf_dist_avx2(x, k, lower, upper, stride, vec_end, end, dist);
+}
+#endif
+
+
+// best level supported by the CPU, lowered by TREEVERIFY_SIMD
+simd_level detect_simd(){
+  simd_level level = SIMD_SCALAR;
+#ifdef TREEVERIFY_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")){
+    level = SIMD_AVX512;
+  }
+  else if (__builtin_cpu_supports("avx2")){
+    level = SIMD_AVX2;
+  }
+#endif
+  const char* forced = getenv("TREEVERIFY_SIMD");
+  if (forced){
+    if (strcmp(forced, "scalar") == 0){
+      level = SIMD_SCALAR;
+    }
+    else if (strcmp(forced, "avx2") == 0){
+      level = std::min(level, SIMD_AVX2);
+    }
+  }
+  return level;
+}
+
+
+const char* simd_name(simd_level level){
+  const char* names[] = {"scalar", "avx2", "avx512"};
+  return names[level];
+}
+
+
+simd_level simd_dispatch_level(){
+  static const simd_level level = detect_simd();
+  return level;
+}
+
+
+void linf_dist(const double* x, int k, const double* lower, const double* upper, size_t stride, size_t n, double* dist){
+#ifdef TREEVERIFY_X86_SIMD
+  switch (simd_dispatch_level()){
+    case SIMD_AVX512:
+      linf_dist_avx512(x, k, lower, upper, stride, 0, n, dist);
+      return;
+    case SIMD_AVX2:
+      linf_dist_avx2(x, k, lower, upper, stride, 0, n, dist);
+      return;
+    default:
+      break;
+  }
+#endif
+  linf_dist_scalar(x, k, lower, upper, stride, 0, n, dist);
+}
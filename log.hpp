@@ -0,0 +1,18 @@
+#pragma once
+#include <iostream>
+
+/*!brief verbosity levels, each one adds to the previous */
+enum log_levels {
+  LOG_QUIET = 0,  // only the final summary
+  LOG_INFO = 1,   // configuration, data shape and one line per point
+  LOG_STEPS = 2,  // every binary search step and target class
+  LOG_DEBUG = 3   // trees, levels and reachable leaves
+};
+
+inline int& log_level(){
+  static int level = LOG_QUIET;
+  return level;
+}
+
+// stream to stdout when the verbosity is at least lvl; the message is not even formatted otherwise
+#define TV_LOG(lvl) if (log_level() < (lvl)) {} else std::cout
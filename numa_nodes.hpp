@@ -0,0 +1,143 @@
+/* NUMA placement of pipeline workers: each node gets its own copy of the model and a share of the point blocks */
+
+#pragma once
+#include <numa.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+
+#include "pipeline.hpp"
+
+/*!brief the NUMA nodes this process may run on, or a single node -1 (no placement) when libnuma is not available */
+inline std::vector<int> numa_run_nodes() {
+    std::vector<int> nodes;
+    if (numa_available() < 0) {
+        nodes.push_back(-1);
+        return nodes;
+    }
+    struct bitmask* mask = numa_get_run_node_mask();
+    for (int node = 0; node <= numa_max_node(); ++node) {
+        if (numa_bitmask_isbitset(mask, node)) {
+            nodes.push_back(node);
+        }
+    }
+    numa_bitmask_free(mask);
+    if (nodes.empty()) {
+        nodes.push_back(-1);
+    }
+    return nodes;
+}
+
+/*!brief number of CPUs of node, 1 for node -1 or when libnuma cannot tell */
+inline int node_cpus(int node) {
+    if (node < 0) {
+        return 1;
+    }
+    struct bitmask* cpus = numa_allocate_cpumask();
+    int n = (numa_node_to_cpus(node, cpus) == 0) ? int(numa_bitmask_weight(cpus)) : 0;
+    numa_bitmask_free(cpus);
+    return std::max(n, 1);
+}
+
+/*!
+ * \brief Split threads workers over nodes in proportion to their CPUs, at least one each, so nodes.size()
+ * must not be above threads. The workers left after rounding down go to the largest remainders, and a
+ * node whose share rounds to none takes one from the node with the most.
+ */
+inline std::vector<int> node_workers(const std::vector<int>& nodes, int threads) {
+    std::vector<int> cpus(nodes.size());
+    int64_t total = 0;
+    for (size_t k = 0; k < nodes.size(); ++k) {
+        cpus[k] = node_cpus(nodes[k]);
+        total += cpus[k];
+    }
+    /* every share and remainder comes from the same threads; left counts those not handed out yet */
+    std::vector<int> workers(nodes.size());
+    std::vector<std::pair<int64_t, size_t>> remainders;
+    int64_t left = threads;
+    for (size_t k = 0; k < nodes.size(); ++k) {
+        workers[k] = int(int64_t(threads) * cpus[k] / total);
+        left -= workers[k];
+        remainders.push_back(std::make_pair(-(int64_t(threads) * cpus[k] % total), k));
+    }
+    std::sort(remainders.begin(), remainders.end());
+    for (size_t i = 0; left > 0 && i < remainders.size(); ++i, --left) {
+        workers[remainders[i].second]++;
+    }
+    for (size_t k = 0; k < nodes.size(); ++k) {
+        if (workers[k] == 0) {
+            std::vector<int>::iterator most = std::max_element(workers.begin(), workers.end());
+            if (*most > 1) {
+                --*most;
+                workers[k] = 1;
+            }
+        }
+    }
+    return workers;
+}
+
+/*!brief run the calling thread on the CPUs of node and allocate its memory there; nothing for node -1 */
+inline void bind_to_node(int node) {
+    if (node < 0) {
+        return;
+    }
+    numa_run_on_node(node);
+    numa_set_localalloc();
+}
+
+/*!
+ * \brief Page allocation counters of one node from /sys/devices/system/node/node<N>/numastat: pages allocated
+ * on the node for a thread running on it (local) and for a thread running on another node (remote).
+ * They count every process of the machine; all 0 when the kernel does not expose them.
+ */
+struct node_memory_stats {
+    uint64_t local;
+    uint64_t remote;
+
+    node_memory_stats() : local(0), remote(0) {
+    }
+
+    static node_memory_stats read(int node) {
+        node_memory_stats stats;
+        if (node < 0) {
+            return stats;
+        }
+        std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/numastat");
+        std::string name;
+        uint64_t value;
+        while (in >> name >> value) {
+            if (name == "local_node") {
+                stats.local = value;
+            }
+            else if (name == "other_node") {
+                stats.remote = value;
+            }
+        }
+        return stats;
+    }
+};
+
+/*!
+ * \brief Hand the blocks of in to the queues of out in turn, each queue getting as many blocks per round as
+ * weights gives it, so the nodes get blocks in proportion to their workers; closes out at the end.
+ */
+inline void distribute_blocks(bounded_queue<point_block>* in, std::vector<bounded_queue<point_block>*> out, std::vector<int> weights) {
+    /* one round: every queue once, then those with weight 2 or more again, and so on */
+    std::vector<size_t> round;
+    for (int w = 0; w < *std::max_element(weights.begin(), weights.end()); ++w) {
+        for (size_t k = 0; k < out.size(); ++k) {
+            if (w < weights[k]) {
+                round.push_back(k);
+            }
+        }
+    }
+    point_block block;
+    for (size_t i = 0; in->pop(block); i = (i + 1) % round.size()) {
+        out[round[i]]->push(std::move(block));
+    }
+    for (size_t k = 0; k < out.size(); ++k) {
+        out[k]->close();
+    }
+}
@@ -0,0 +1,182 @@
+#!/usr/bin/env python3
+"""End-to-end performance regression check for treeVerify.
+
+Runs treeVerify on the bundled models and on generated synthetic models, and
+records the total time, the per-point time distribution (p50/p99), the peak
+RSS and the resulting average bound and verified error of each case. The
+results are compared with a stored baseline: any change of the bound or error
+is a failure, and so is a slowdown beyond the threshold.
+
+    ./perf_regress.py                  # compare with perf_baseline.json
+    ./perf_regress.py --update         # record a new baseline on this machine
+
+Times are only comparable on the machine that recorded the baseline.
+"""
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+import tempfile
+import time
+
+# each case runs a config file with overrides, or generates a synthetic model with gen-synth first
+CASES = [
+    {"name": "breast_cancer", "config": "example.json", "overrides": {}},
+    {"name": "higgs", "config": None, "overrides": {
+        "inputs": "ori_higgs0", "model": "higgs_robust.0050.json", "start_idx": 0, "num_attack": 10,
+        "eps_init": 0.3, "max_clique": 2, "max_search": 10, "max_level": 1, "num_classes": 2,
+        "feature_start": 0}},
+    {"name": "synth_t50_d5", "synth": ["trees=50", "depth=5", "features=20", "points=50", "thresholds=16", "seed=1"],
+     "overrides": {"eps_init": 0.05}},
+    {"name": "synth_t20_d8", "synth": ["trees=20", "depth=8", "features=50", "points=20", "seed=2"],
+     "overrides": {"eps_init": 0.05}},
+    {"name": "synth_3class", "synth": ["trees=10", "depth=4", "features=10", "classes=3", "points=50", "seed=3"],
+     "overrides": {"eps_init": 0.05}},
+]
+
+SUMMARY_PATTERNS = {
+    "average_bound": r"clique method average bound:\s*([-+0-9.eE]+)",
+    "verified_error": r"verified error at epsilon [-+0-9.eE]+ = ([-+0-9.eE]+)",
+}
+
+
+def percentile(values, q):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    k = (len(values) - 1) * q / 100.0
+    lo = int(k)
+    hi = min(lo + 1, len(values) - 1)
+    return values[lo] + (values[hi] - values[lo]) * (k - lo)
+
+
+def run_case(binary, case, workdir, repeat):
+    if "synth" in case:
+        prefix = os.path.join(workdir, case["name"])
+        subprocess.check_call([binary, "gen-synth", prefix] + case["synth"], stdout=subprocess.DEVNULL)
+        with open(prefix + ".config.json") as f:
+            config = json.load(f)
+    elif case["config"]:
+        with open(case["config"]) as f:
+            config = json.load(f)
+    else:
+        config = {}
+    config.update(case["overrides"])
+    results_file = os.path.join(workdir, case["name"] + ".jsonl")
+    config["results"] = results_file
+    config["verbosity"] = 0
+    config_file = os.path.join(workdir, case["name"] + ".config.run.json")
+    with open(config_file, "w") as f:
+        json.dump(config, f, indent=4)
+
+    walls = []
+    rss = []
+    point_us = []
+    summary = {}
+    for _ in range(repeat):
+        start = time.perf_counter()
+        proc = subprocess.Popen([binary, config_file], stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+        out = proc.stdout.read()
+        # wait4 instead of wait, for the resource usage of this child alone
+        _, status, usage = os.wait4(proc.pid, 0)
+        proc.returncode = status  # already reaped, keep Popen from waiting again
+        walls.append(time.perf_counter() - start)
+        if not os.WIFEXITED(status) or os.WEXITSTATUS(status) != 0:
+            raise RuntimeError("%s %s failed:\n%s" % (binary, config_file, out.decode(errors="replace")))
+        # ru_maxrss is in kilobytes on Linux
+        rss.append(usage.ru_maxrss / 1024.0)
+        text = out.decode(errors="replace")
+        for key, pattern in SUMMARY_PATTERNS.items():
+            m = re.search(pattern, text)
+            if not m:
+                raise RuntimeError("no '%s' in the output of %s" % (key, config_file))
+            summary[key] = float(m.group(1))
+        with open(results_file) as f:
+            point_us = [json.loads(line)["time_us"]["total"] for line in f if line.strip()]
+
+    walls.sort()
+    return {
+        "points": len(point_us),
+        "total_s": walls[len(walls) // 2],
+        "p50_point_us": percentile(point_us, 50),
+        "p99_point_us": percentile(point_us, 99),
+        "peak_rss_mb": max(rss),
+        "average_bound": summary["average_bound"],
+        "verified_error": summary["verified_error"],
+    }
+
+
+def compare(name, result, base, args):
+    """return a list of failure messages"""
+    failures = []
+    for key in ("average_bound", "verified_error"):
+        if abs(result[key] - base[key]) > args.tolerance:
+            failures.append("%s: %s changed from %g to %g" % (name, key, base[key], result[key]))
+    for key in ("total_s", "p50_point_us", "p99_point_us"):
+        # ignore noise on very short timings
+        floor = 0.05 if key == "total_s" else 1000.0
+        if result[key] > max(base[key], floor) * args.max_slowdown:
+            failures.append("%s: %s is %.3g, baseline %.3g (limit %.2fx)" % (name, key, result[key], base[key], args.max_slowdown))
+    if result["peak_rss_mb"] > base["peak_rss_mb"] * args.max_rss_growth:
+        failures.append("%s: peak_rss_mb is %.1f, baseline %.1f (limit %.2fx)" % (name, result["peak_rss_mb"], base["peak_rss_mb"], args.max_rss_growth))
+    return failures
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--binary", default="./treeVerify", help="treeVerify executable")
+    parser.add_argument("--baseline", default="perf_baseline.json", help="baseline file")
+    parser.add_argument("--update", action="store_true", help="write the results as the new baseline")
+    parser.add_argument("--repeat", type=int, default=3, help="runs per case, the median total time is used")
+    parser.add_argument("--cases", default="", help="comma separated case names, default all")
+    parser.add_argument("--max-slowdown", type=float, default=1.25, help="fail when a time grows by more than this factor")
+    parser.add_argument("--max-rss-growth", type=float, default=1.25, help="fail when the peak RSS grows by more than this factor")
+    parser.add_argument("--tolerance", type=float, default=1e-6, help="allowed change of the bound and the verified error")
+    args = parser.parse_args()
+
+    cases = CASES
+    if args.cases:
+        wanted = args.cases.split(",")
+        cases = [c for c in CASES if c["name"] in wanted]
+
+    results = {}
+    with tempfile.TemporaryDirectory(prefix="perf_regress_") as workdir:
+        for case in cases:
+            results[case["name"]] = run_case(args.binary, case, workdir, args.repeat)
+            r = results[case["name"]]
+            print("%-16s %4d points  total %8.3f s  p50 %10.0f us  p99 %10.0f us  rss %7.1f MB  bound %.6g  error %.6g" % (
+                case["name"], r["points"], r["total_s"], r["p50_point_us"], r["p99_point_us"], r["peak_rss_mb"],
+                r["average_bound"], r["verified_error"]))
+
+    if args.update:
+        baseline = {}
+        if os.path.exists(args.baseline):
+            with open(args.baseline) as f:
+                baseline = json.load(f)
+        baseline.update(results)
+        with open(args.baseline, "w") as f:
+            json.dump(baseline, f, indent=2, sort_keys=True)
+            f.write("\n")
+        print("baseline written to %s" % args.baseline)
+        return 0
+
+    with open(args.baseline) as f:
+        baseline = json.load(f)
+    failures = []
+    for name, result in results.items():
+        if name not in baseline:
+            print("%s: not in the baseline, skipped" % name)
+            continue
+        failures += compare(name, result, baseline[name], args)
+    for failure in failures:
+        print("FAIL " + failure)
+    if not failures:
+        print("OK")
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,83 @@
+/* Pipelined verification: points are read while the model is loaded, and verified as soon as they are read */
+
+#pragma once
+#include <string>
+#include <exception>
+#include <boost/thread/mutex.hpp>
+
+#include "svmreader.hpp"
+#include "queue.hpp"
+
+/*!brief points handed to a worker at a time, small so that the first results come out quickly */
+static const size_t PipelineBlockRows = 16;
+/*!brief blocks read ahead of the workers */
+static const size_t PipelineQueueBlocks = 256;
+
+/*!brief consecutive examples of the input, examples first to first + rows().size() - 1 of the requested range */
+struct point_block {
+    size_t first;
+    /*!brief parsed examples, or empty when view points into a mapped binary dataset */
+    example_data data;
+    data_view view;
+    bool mapped;
+
+    point_block() : first(0), mapped(false) {
+    }
+    data_view rows() const {
+        return mapped ? view : data.view();
+    }
+};
+
+/*!brief the first exception thrown by any thread of a pipeline, rethrown by the main thread */
+class pipeline_error {
+    public:
+        void set(std::exception_ptr e) {
+            boost::lock_guard<boost::mutex> lock(mux);
+            if (!error) {
+                error = e;
+            }
+        }
+        void rethrow() {
+            boost::lock_guard<boost::mutex> lock(mux);
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+    private:
+        std::exception_ptr error;
+        boost::mutex mux;
+};
+
+/*!brief parse max_rows examples of a LIBSVM file from start_row, in blocks of block_rows; closes the queue at the end */
+inline void produce_libsvm_blocks(const std::string& file, size_t start_row, size_t max_rows, size_t block_rows, bounded_queue<point_block>* queue, pipeline_error* error) {
+    try {
+        example_data unused;
+        svm_reader reader(file, unused);
+        reader.set_range(start_row, max_rows);
+        bool ok = reader.stream(block_rows, [&](size_t first, example_data& data) {
+            point_block block;
+            block.first = first;
+            std::swap(block.data, data);
+            queue->push(std::move(block));
+        });
+        if (!ok) {
+            throw std::invalid_argument("cannot read LIBSVM file " + file);
+        }
+    }
+    catch (...) {
+        error->set(std::current_exception());
+    }
+    queue->close();
+}
+
+/*!brief hand out the rows of an already mapped dataset in blocks of block_rows; closes the queue at the end */
+inline void produce_view_blocks(data_view view, size_t block_rows, bounded_queue<point_block>* queue) {
+    for (size_t first = 0; first < view.size(); first += block_rows) {
+        point_block block;
+        block.first = first;
+        block.view = view.slice(first, block_rows);
+        block.mapped = true;
+        queue->push(std::move(block));
+    }
+    queue->close();
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <deque>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+
+/*!brief FIFO shared by producer and consumer threads. push() blocks while it holds capacity items, which slows the producers down to the pace of the consumers. */
+template<typename T>
+class bounded_queue {
+  public:
+  explicit bounded_queue(size_t capacity) : capacity(capacity), closed(false) {}
+  void push(T&& item){
+    boost::unique_lock<boost::mutex> lock(mux);
+    while (items.size() >= capacity){
+      not_full.wait(lock);
+    }
+    items.push_back(std::move(item));
+    not_empty.notify_one();
+  }
+  /*!brief wait for an item, false once the queue is closed and empty */
+  bool pop(T& item){
+    boost::unique_lock<boost::mutex> lock(mux);
+    while (items.empty() && !closed){
+      not_empty.wait(lock);
+    }
+    if (items.empty()){
+      return false;
+    }
+    item = std::move(items.front());
+    items.pop_front();
+    not_full.notify_one();
+    return true;
+  }
+  /*!brief wait for at least one item, then append up to max_batch of them to batch; false once the queue is closed and empty */
+  bool pop_batch(std::vector<T>& batch, size_t max_batch){
+    boost::unique_lock<boost::mutex> lock(mux);
+    while (items.empty() && !closed){
+      not_empty.wait(lock);
+    }
+    if (items.empty()){
+      return false;
+    }
+    for (size_t i=0; i<max_batch && !items.empty(); i++){
+      batch.push_back(std::move(items.front()));
+      items.pop_front();
+    }
+    not_full.notify_all();
+    return true;
+  }
+  /*!brief no more items will be pushed, wakes up every waiting consumer */
+  void close(){
+    boost::lock_guard<boost::mutex> lock(mux);
+    closed = true;
+    not_empty.notify_all();
+  }
+
+  private:
+  size_t capacity;
+  bool closed;
+  std::deque<T> items;
+  boost::mutex mux;
+  boost::condition_variable not_empty;
+  boost::condition_variable not_full;
+
+  bounded_queue(const bounded_queue&);
+  bounded_queue& operator=(const bounded_queue&);
+};
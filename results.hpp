@@ -0,0 +1,96 @@
+#pragma once
+#include <stdio.h>
+#include <string>
+#include <stdexcept>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+
+/*!brief Appends lines to a file from a background thread, the verification loop only copies them into a buffer */
+class result_writer {
+  public:
+  result_writer() : file(NULL), stop(false), writer(NULL) {}
+  ~result_writer(){
+    close();
+  }
+  void open(const std::string& path){
+    file = fopen(path.c_str(), "w");
+    if (!file){
+      throw std::invalid_argument("cannot open results file " + path);
+    }
+    stop = false;
+    writer = new boost::thread(boost::bind(&result_writer::writer_proc, this));
+  }
+  bool is_open() const {
+    return file != NULL;
+  }
+  /*!brief queue one line, newline is added */
+  void write(const std::string& line){
+    bool full;
+    {
+      boost::lock_guard<boost::mutex> lock(mux);
+      pending.append(line);
+      pending.push_back('\n');
+      full = pending.size() >= FlushSize;
+    }
+    if (full){
+      cond.notify_one();
+    }
+  }
+  /*!brief write everything queued and close the file */
+  void close(){
+    if (!file){
+      return;
+    }
+    {
+      boost::lock_guard<boost::mutex> lock(mux);
+      stop = true;
+    }
+    cond.notify_one();
+    writer->join();
+    delete writer;
+    writer = NULL;
+    fclose(file);
+    file = NULL;
+  }
+
+  private:
+  /*!brief the writer wakes up when this much is queued, or every FlushInterval milliseconds */
+  static const size_t FlushSize = 1 << 16;
+  static const int FlushInterval = 200;
+  FILE* file;
+  bool stop;
+  boost::thread* writer;
+  boost::mutex mux;
+  boost::condition_variable cond;
+  std::string pending;
+
+  void writer_proc(){
+    std::string out;
+    while (true){
+      bool exiting;
+      {
+        boost::unique_lock<boost::mutex> lock(mux);
+        if (!stop && pending.size() < FlushSize){
+          cond.timed_wait(lock, boost::posix_time::milliseconds(FlushInterval));
+        }
+        // swap buffers and write outside the lock
+        out.swap(pending);
+        exiting = stop;
+      }
+      if (!out.empty()){
+        fwrite(out.data(), 1, out.size(), file);
+        fflush(file);
+        out.clear();
+      }
+      if (exiting){
+        break;
+      }
+    }
+  }
+
+  result_writer(const result_writer&);
+  result_writer& operator=(const result_writer&);
+};
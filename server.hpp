@@ -0,0 +1,443 @@
+/* Verification daemon: load the model once and answer newline-delimited JSON requests on a Unix socket */
+
+#pragma once
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <stdexcept>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include "json/single_include/nlohmann/json.hpp"
+#include "log.hpp"
+#include "queue.hpp"
+#include "verifier.hpp"
+
+/*!brief requests longer than this are rejected and the connection is closed */
+static const size_t MaxRequestBytes = 64 << 20;
+
+/*!brief One client connection. The socket is closed when the reader and every pending request have released it. */
+class serve_connection {
+    public:
+        explicit serve_connection(int fd) : fd(fd) {
+        }
+        ~serve_connection() {
+            close(fd);
+        }
+        /*!brief send one response line; lines from concurrent workers are never interleaved */
+        void send_line(const std::string& line) {
+            boost::lock_guard<boost::mutex> lock(write_mux);
+            std::string out = line + '\n';
+            const char* p = out.data();
+            size_t left = out.size();
+            while (left > 0) {
+                ssize_t n = send(fd, p, left, MSG_NOSIGNAL);
+                if (n < 0) {
+                    if (errno == EINTR) continue;
+                    /* the client went away, its remaining responses are dropped */
+                    return;
+                }
+                p += n;
+                left -= n;
+            }
+        }
+        const int fd;
+    private:
+        boost::mutex write_mux;
+        serve_connection(const serve_connection&);
+        serve_connection& operator=(const serve_connection&);
+};
+
+struct serve_request {
+    std::shared_ptr<serve_connection> conn;
+    std::string line;
+    std::chrono::steady_clock::time_point received;
+};
+
+/*!brief requests waiting for a worker; when it is full, readers stop reading from their sockets and clients are slowed down */
+typedef bounded_queue<serve_request> request_queue;
+
+/*!
+ * \brief A request line, parsed. Requests are JSON objects with
+ *   "x": [values] (x[i] is feature i + feature_start) or "features": {"index": value, ...} (LIBSVM style, missing features are 0),
+ *   "label": the class predicted for the point,
+ *   "eps": verify at this eps only; without it the largest robust eps is searched, from "eps_init" for "max_search" steps
+ *          (both default to the config file),
+ *   "deadline_ms": optional, the request fails if no worker has started it this long after it was received,
+ *          and a search still running then stops before its next eps step,
+ *   "id": optional, copied to the response.
+ */
+struct parsed_request {
+    std::vector<double> x;
+    int label;
+    bool single_eps;
+    double eps;
+    double eps_init;
+    int max_search;
+    std::chrono::steady_clock::time_point deadline;
+};
+
+/*!brief parse request into parsed, copying its id to response; throws invalid_argument on a malformed request */
+inline void parse_request(const treeverify::Verifier& verifier, const serve_request& request, parsed_request& parsed, nlohmann::json& response) {
+    using nlohmann::json;
+    json req = json::parse(request.line);
+    if (req.find("id") != req.end()) {
+        response["id"] = req["id"];
+    }
+    parsed.deadline = std::chrono::steady_clock::time_point::max();
+    if (req.find("deadline_ms") != req.end()) {
+        parsed.deadline = request.received + std::chrono::milliseconds(int64_t(double(req["deadline_ms"])));
+    }
+    if (req.find("label") == req.end()) {
+        throw std::invalid_argument("label is missing");
+    }
+    parsed.label = int(req["label"]);
+    const treeverify::verifier_options& opt = verifier.options();
+    /* x covers every feature the model splits on */
+    size_t n_features = verifier.used_features().size();
+    std::vector<double>& x = parsed.x;
+    x.assign(n_features > size_t(opt.feature_start) ? n_features - opt.feature_start : 0, 0.0);
+    if (req.find("x") != req.end()) {
+        const json& values = req["x"];
+        if (values.size() > x.size()) {
+            x.resize(values.size(), 0.0);
+        }
+        for (size_t i = 0; i < values.size(); ++i) {
+            x[i] = double(values[i]);
+        }
+    }
+    else if (req.find("features") != req.end()) {
+        const json& features = req["features"];
+        for (auto it = features.begin(); it != features.end(); ++it) {
+            long index = strtol(it.key().c_str(), NULL, 10) - opt.feature_start;
+            if (index < 0) continue;
+            if (size_t(index) >= x.size()) {
+                throw std::invalid_argument("feature " + it.key() + " is beyond the " + std::to_string(n_features) + " features of the model");
+            }
+            x[index] = double(it.value());
+        }
+    }
+    else {
+        throw std::invalid_argument("x or features is missing");
+    }
+    parsed.single_eps = (req.find("eps") != req.end());
+    parsed.eps = parsed.single_eps ? double(req["eps"]) : 0;
+    parsed.eps_init = (req.find("eps_init") != req.end()) ? double(req["eps_init"]) : opt.eps_init;
+    parsed.max_search = (req.find("max_search") != req.end()) ? int(req["max_search"]) : opt.max_search;
+}
+
+/*!brief true if the request is a search with the options of the Verifier, which the batched max_eps runs */
+inline bool batched_search(const treeverify::Verifier& verifier, const parsed_request& parsed) {
+    const treeverify::verifier_options& opt = verifier.options();
+    return !parsed.single_eps && parsed.eps_init == opt.eps_init && parsed.max_search == opt.max_search;
+}
+
+inline void bound_response(const treeverify::bound_result& res, nlohmann::json& response) {
+    response["bound"] = res.bound;
+    response["eps"] = res.eps;
+    response["robust"] = res.robust;
+    response["time_us"] = {{"reach", res.reach_us}, {"clique", res.clique_us}};
+    if (res.reused > 0) {
+        response["reused"] = res.reused;
+    }
+    if (res.expired) {
+        response["error"] = "deadline exceeded";
+    }
+}
+
+inline void time_response(const serve_request& request, std::chrono::steady_clock::time_point start, nlohmann::json& response) {
+    response["time_us"]["queue"] = std::chrono::duration_cast<std::chrono::microseconds>(start - request.received).count();
+    response["time_us"]["total"] = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - request.received).count();
+}
+
+/*!brief answer one parsed request on its own */
+inline void serve_one(const treeverify::Verifier& verifier, const serve_request& request, const parsed_request& parsed,
+                      std::chrono::steady_clock::time_point start, treeverify::certified_bounds* reuse, nlohmann::json& response) {
+    if (parsed.single_eps) {
+        treeverify::verify_result res = verifier.verify(parsed.x, parsed.label, parsed.eps, NULL, reuse);
+        response["robust"] = res.robust;
+        response["scores"] = res.scores;
+        response["time_us"] = {{"reach", res.reach_us}, {"clique", res.clique_us}};
+        if (res.reused > 0) {
+            response["reused"] = res.reused;
+        }
+    }
+    else {
+        bound_response(verifier.max_eps(parsed.x, parsed.label, parsed.eps_init, parsed.max_search, NULL, reuse, parsed.deadline), response);
+    }
+    time_response(request, start, response);
+}
+
+/*!
+ * \brief Answer a batch of requests taken from the queue together. The searches that use the options of the
+ * Verifier go to the batched max_eps, so the distances of all their points are computed while each tree is in
+ * cache; every other request is answered on its own as soon as it is parsed.
+ * With reuse, bounds of earlier requests are reused for nearby points, and the response has "reused" when one was.
+ */
+inline void serve_batch(const treeverify::Verifier& verifier, const std::vector<serve_request>& batch, treeverify::certified_bounds* reuse) {
+    using nlohmann::json;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<json> responses(batch.size());
+    std::vector<size_t> searched;
+    std::vector<std::vector<double>> points;
+    std::vector<int> labels;
+    std::vector<std::chrono::steady_clock::time_point> deadlines;
+    for (size_t i = 0; i < batch.size(); ++i) {
+        try {
+            parsed_request parsed;
+            parse_request(verifier, batch[i], parsed, responses[i]);
+            if (start > parsed.deadline) {
+                responses[i]["error"] = "deadline exceeded";
+            }
+            else if (batched_search(verifier, parsed)) {
+                searched.push_back(i);
+                points.push_back(std::move(parsed.x));
+                labels.push_back(parsed.label);
+                deadlines.push_back(parsed.deadline);
+                continue;
+            }
+            else {
+                serve_one(verifier, batch[i], parsed, start, reuse, responses[i]);
+            }
+        }
+        catch (const std::exception& e) {
+            responses[i]["error"] = e.what();
+        }
+        batch[i].conn->send_line(responses[i].dump());
+    }
+    if (searched.empty()) {
+        return;
+    }
+    try {
+        std::vector<treeverify::bound_result> res = verifier.max_eps(points, labels, NULL, reuse, &deadlines);
+        for (size_t k = 0; k < searched.size(); ++k) {
+            bound_response(res[k], responses[searched[k]]);
+            time_response(batch[searched[k]], start, responses[searched[k]]);
+        }
+    }
+    catch (const std::exception& e) {
+        for (size_t k = 0; k < searched.size(); ++k) {
+            responses[searched[k]]["error"] = e.what();
+        }
+    }
+    for (size_t k = 0; k < searched.size(); ++k) {
+        batch[searched[k]].conn->send_line(responses[searched[k]].dump());
+    }
+}
+
+/*!brief split the byte stream of a connection into lines and queue them */
+inline void serve_reader(std::shared_ptr<serve_connection> conn, request_queue* queue) {
+    std::string buf;
+    char chunk[1 << 16];
+    while (true) {
+        ssize_t n = recv(conn->fd, chunk, sizeof(chunk), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        buf.append(chunk, n);
+        size_t start = 0;
+        size_t newline;
+        while ((newline = buf.find('\n', start)) != std::string::npos) {
+            if (newline > start) {
+                serve_request request = {conn, buf.substr(start, newline - start), std::chrono::steady_clock::now()};
+                queue->push(std::move(request));
+            }
+            start = newline + 1;
+        }
+        buf.erase(0, start);
+        if (buf.size() > MaxRequestBytes) {
+            conn->send_line("{\"error\":\"request too long\"}");
+            return;
+        }
+    }
+    /* a last request without a newline */
+    if (buf.find_first_not_of(" \t\r") != std::string::npos) {
+        serve_request request = {conn, buf, std::chrono::steady_clock::now()};
+        queue->push(std::move(request));
+    }
+}
+
+inline void serve_worker(const treeverify::Verifier* verifier, request_queue* queue, size_t max_batch, treeverify::certified_bounds* reuse) {
+    std::vector<serve_request> batch;
+    while (queue->pop_batch(batch, max_batch)) {
+        serve_batch(*verifier, batch, reuse);
+        /* release the connections before waiting again */
+        batch.clear();
+    }
+}
+
+/*!brief socket path removed on SIGINT and SIGTERM */
+static char serve_socket_path[sizeof(((sockaddr_un*)0)->sun_path)];
+
+inline void serve_stop(int) {
+    unlink(serve_socket_path);
+    _exit(0);
+}
+
+inline int serve_connect_or_listen(const std::string& path, bool listening) {
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        throw std::invalid_argument("socket path too long: " + path);
+    }
+    strcpy(addr.sun_path, path.c_str());
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+        throw std::runtime_error("cannot create socket");
+    }
+    if (listening) {
+        unlink(path.c_str());
+        if (::bind(fd, (sockaddr*)&addr, sizeof(addr)) == -1 || ::listen(fd, 64) == -1) {
+            close(fd);
+            throw std::runtime_error("cannot listen on " + path + ": " + strerror(errno));
+        }
+    }
+    else if (::connect(fd, (sockaddr*)&addr, sizeof(addr)) == -1) {
+        close(fd);
+        throw std::runtime_error("cannot connect to " + path + ": " + strerror(errno));
+    }
+    return fd;
+}
+
+/*!
+ * \brief treeVerify serve <config.json> <socket> [workers=N] [queue=N] [batch=N]
+ * The model and search options come from the configuration file, its inputs are not used.
+ * Workers take up to batch requests at a time from a queue of at most queue requests and verify their
+ * searches together; each response is written as soon as it is ready, so responses may come back out of order.
+ */
+inline int serve(int argc, char** argv) {
+    if (argc < 4) {
+        std::cerr << "usage: " << argv[0] << " serve <config.json> <socket> [workers=N] [queue=1024] [batch=16]\n";
+        return 1;
+    }
+    size_t n_workers = std::max(1u, boost::thread::hardware_concurrency());
+    size_t capacity = 1024;
+    size_t max_batch = 16;
+    for (int i = 4; i < argc; ++i) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        std::string key = arg.substr(0, eq);
+        long value = (eq == std::string::npos) ? 0 : atol(arg.c_str() + eq + 1);
+        if (value < 1) {
+            std::cerr << "invalid parameter " << arg << '\n';
+            return 1;
+        }
+        if (key == "workers") n_workers = value;
+        else if (key == "queue") capacity = value;
+        else if (key == "batch") max_batch = value;
+        else {
+            std::cerr << "unknown parameter " << arg << '\n';
+            return 1;
+        }
+    }
+    std::ifstream config_file(argv[2]);
+    if (!config_file) {
+        throw std::invalid_argument(std::string("cannot open config file ") + argv[2]);
+    }
+    nlohmann::json config;
+    config_file >> config;
+    if (config.find("model") == config.end()) {
+        throw std::invalid_argument("model is missing in config file");
+    }
+    if (config.find("verbosity") != config.end()) {
+        log_level() = int(config["verbosity"]);
+    }
+    treeverify::Verifier verifier(config["model"].get<std::string>(), treeverify::verifier_options::from_config(config));
+    /* bounds certified for earlier requests, shared by the workers when the config sets reuse_bounds */
+    std::unique_ptr<treeverify::certified_bounds> reuse;
+    if (config.find("reuse_bounds") != config.end() && int(config["reuse_bounds"])) {
+        reuse.reset(new treeverify::certified_bounds(verifier));
+    }
+
+    std::string path = argv[3];
+    int listen_fd = serve_connect_or_listen(path, true);
+    strcpy(serve_socket_path, path.c_str());
+    signal(SIGINT, serve_stop);
+    signal(SIGTERM, serve_stop);
+    signal(SIGPIPE, SIG_IGN);
+
+    request_queue queue(capacity);
+    boost::thread_group workers;
+    for (size_t i = 0; i < n_workers; ++i) {
+        workers.create_thread(boost::bind(&serve_worker, &verifier, &queue, max_batch, reuse.get()));
+    }
+    std::cout << "serving " << config["model"].get<std::string>() << " (" << verifier.num_trees() << " trees, "
+              << verifier.num_leaves() << " leaves) on " << path << " with " << n_workers << " workers" << std::endl;
+    while (true) {
+        int fd = ::accept(listen_fd, NULL, NULL);
+        if (fd == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            std::cerr << "accept failed: " << strerror(errno) << '\n';
+            break;
+        }
+        boost::thread reader(boost::bind(&serve_reader, std::make_shared<serve_connection>(fd), &queue));
+        reader.detach();
+    }
+    close(listen_fd);
+    unlink(path.c_str());
+    return 1;
+}
+
+inline void client_sender(int fd, std::istream* in) {
+    std::string line;
+    while (std::getline(*in, line)) {
+        line.push_back('\n');
+        const char* p = line.data();
+        size_t left = line.size();
+        while (left > 0) {
+            ssize_t n = send(fd, p, left, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return;
+            p += n;
+            left -= n;
+        }
+    }
+    shutdown(fd, SHUT_WR);
+}
+
+/*!
+ * \brief treeVerify client <socket> [requests.jsonl]
+ * Send request lines from the file (or stdin) and print every response until the server has answered all of them.
+ */
+inline int serve_client(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "usage: " << argv[0] << " client <socket> [requests.jsonl]\n";
+        return 1;
+    }
+    std::ifstream file;
+    std::istream* in = &std::cin;
+    if (argc > 3) {
+        file.open(argv[3]);
+        if (!file) {
+            std::cerr << "cannot open " << argv[3] << '\n';
+            return 1;
+        }
+        in = &file;
+    }
+    int fd = serve_connect_or_listen(argv[2], false);
+    /* send from another thread, so a slow reader here never blocks the server's responses */
+    boost::thread sender(boost::bind(&client_sender, fd, in));
+    char chunk[1 << 16];
+    while (true) {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        std::cout.write(chunk, n);
+    }
+    std::cout.flush();
+    sender.join();
+    close(fd);
+    return 0;
+}
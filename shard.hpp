@@ -0,0 +1,179 @@
+/* Sharded runs: each process verifies a slice of the points and writes its per point results, merge adds them up */
+
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include "json/single_include/nlohmann/json.hpp"
+
+/*!brief configuration keys that do not change the results, ignored when checking that shards belong to one run */
+static const char* const ShardLocalKeys[] = {"results", "counters", "verbosity", "threads", "pipeline", "batch", "clique_cache", "checkpoint"};
+
+/*!
+ * \brief The slice of the points of a run verified by one process: shard index of count.
+ * Contiguous shards split start_idx .. start_idx+num_attack-1 into count consecutive ranges, interleaved
+ * shards take every count-th point of it, which balances runs where cost grows along the file.
+ */
+struct shard_spec {
+    int index;
+    int count;
+    bool interleaved;
+
+    shard_spec() : index(0), count(1), interleaved(false) {
+    }
+
+    /*!brief parse "i/N", throws invalid_argument */
+    static shard_spec parse(const std::string& text, bool interleaved) {
+        shard_spec shard;
+        size_t slash = text.find('/');
+        char* end = NULL;
+        shard.index = int(strtol(text.c_str(), &end, 10));
+        if (slash == std::string::npos || end != text.c_str() + slash) {
+            throw std::invalid_argument("shard must be i/N, got " + text);
+        }
+        shard.count = int(strtol(text.c_str() + slash + 1, &end, 10));
+        if (*end != '\0' || shard.count < 1 || shard.index < 0 || shard.index >= shard.count) {
+            throw std::invalid_argument("shard must be i/N with 0 <= i < N, got " + text);
+        }
+        shard.interleaved = interleaved;
+        return shard;
+    }
+
+    /*!brief narrow start_idx and num_attack to a contiguous shard; interleaved shards read every point */
+    void slice(int& start_idx, int& num_attack) const {
+        if (interleaved) {
+            return;
+        }
+        int first = int(int64_t(num_attack) * index / count);
+        int last = int(int64_t(num_attack) * (index + 1) / count);
+        start_idx += first;
+        num_attack = last - first;
+    }
+
+    /*!brief true if the point at offset n from the start_idx of the slice is verified by this shard */
+    bool contains(int n) const {
+        return !interleaved || n % count == index;
+    }
+};
+
+/*!brief header of the file of one shard: the shard and the run it belongs to */
+inline nlohmann::json shard_header(const shard_spec& shard, const nlohmann::json& config, int start_idx, int num_attack, double eps_init) {
+    nlohmann::json run = config;
+    for (size_t i = 0; i < sizeof(ShardLocalKeys) / sizeof(ShardLocalKeys[0]); ++i) {
+        run.erase(ShardLocalKeys[i]);
+    }
+    nlohmann::json header;
+    header["shard"] = shard.index;
+    header["shards"] = shard.count;
+    header["interleaved"] = shard.interleaved;
+    header["start_idx"] = start_idx;
+    header["num_attack"] = num_attack;
+    header["eps_init"] = eps_init;
+    header["config"] = run;
+    return header;
+}
+
+/*!brief write header and points (index, bound, initially_robust of every point) to path */
+inline void write_shard(const std::string& path, nlohmann::json header, const nlohmann::json& points, double seconds) {
+    header["seconds"] = seconds;
+    header["points"] = points;
+    std::ofstream out(path);
+    out << header.dump() << '\n';
+    if (!out) {
+        throw std::invalid_argument("cannot write shard results to " + path);
+    }
+}
+
+/*!
+ * \brief treeVerify merge <shard.json> ...
+ * Check that the files are the shards 0 .. N-1 of one run, each given once, and print the average bound
+ * and verified error of the whole run. Bounds are added in point order, as a single run does, so the
+ * statistics are exactly those of running every point in one process, except with reuse_bounds: a shard
+ * only reuses the bounds of its own points, so its searches differ from those of a single run.
+ */
+inline int merge_shards(int argc, char** argv) {
+    using nlohmann::json;
+    if (argc < 3) {
+        std::cerr << "usage: " << argv[0] << " merge <shard.json> ...\n";
+        return 1;
+    }
+    json first;
+    std::vector<bool> seen;
+    std::vector<std::pair<int, std::pair<double, bool>>> points;
+    double seconds = 0;
+    double longest = 0;
+    for (int i = 2; i < argc; ++i) {
+        std::ifstream in(argv[i]);
+        if (!in) {
+            std::cerr << "cannot open " << argv[i] << '\n';
+            return 1;
+        }
+        json shard;
+        in >> shard;
+        if (i == 2) {
+            first = shard;
+            if (int(first["shards"]) < 1) {
+                std::cerr << argv[i] << " has " << int(first["shards"]) << " shards\n";
+                return 1;
+            }
+            seen.assign(int(first["shards"]), false);
+        }
+        else if (shard["shards"] != first["shards"] || shard["interleaved"] != first["interleaved"] || shard["start_idx"] != first["start_idx"]
+                 || shard["num_attack"] != first["num_attack"] || shard["eps_init"] != first["eps_init"] || shard["config"] != first["config"]) {
+            std::cerr << argv[i] << " is not a shard of the same run as " << argv[2] << '\n';
+            return 1;
+        }
+        int index = int(shard["shard"]);
+        if (index < 0 || index >= int(seen.size())) {
+            std::cerr << argv[i] << " is shard " << index << ", not one of 0 .. " << seen.size() - 1 << '\n';
+            return 1;
+        }
+        if (seen[index]) {
+            std::cerr << "shard " << index << " is given twice\n";
+            return 1;
+        }
+        seen[index] = true;
+        const json& shard_points = shard["points"];
+        for (size_t j = 0; j < shard_points.size(); ++j) {
+            points.push_back(std::make_pair(int(shard_points[j]["index"]), std::make_pair(double(shard_points[j]["bound"]), bool(shard_points[j]["initially_robust"]))));
+        }
+        seconds += double(shard["seconds"]);
+        longest = std::max(longest, double(shard["seconds"]));
+    }
+    for (size_t s = 0; s < seen.size(); ++s) {
+        if (!seen[s]) {
+            std::cerr << "shard " << s << " of " << seen.size() << " is missing\n";
+            return 1;
+        }
+    }
+    std::sort(points.begin(), points.end());
+    for (size_t j = 1; j < points.size(); ++j) {
+        if (points[j].first == points[j - 1].first) {
+            std::cerr << "point " << points[j].first << " is in two shards\n";
+            return 1;
+        }
+    }
+    double avg_bound = 0;
+    int n_initial_success = 0;
+    for (size_t j = 0; j < points.size(); ++j) {
+        avg_bound = avg_bound + points[j].second.first;
+        n_initial_success += points[j].second.second;
+    }
+    int num_attack = int(points.size());
+    double verified_err = (num_attack > 0) ? 1.0 - n_initial_success / (double)num_attack : 0;
+    avg_bound = (num_attack > 0) ? avg_bound / num_attack : 0;
+    std::cout << "merged " << seen.size() << " shards, " << num_attack << " points, " << seconds << " seconds in total, longest shard " << longest << " seconds\n";
+    const json& config = first["config"];
+    if (config.find("reuse_bounds") != config.end() && int(config["reuse_bounds"])) {
+        std::cout << "reuse_bounds is set, so the bounds depend on how the points were split into shards\n";
+    }
+    std::cout << "\nclique method average bound:" << avg_bound << std::endl;
+    std::cout << "verified error at epsilon " << double(first["eps_init"]) << " = " << verified_err << std::endl;
+    return 0;
+}
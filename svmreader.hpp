@@ -1,14 +1,19 @@
 #pragma once
-#include <uv.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <boost/bind.hpp>
-#include <boost/atomic.hpp>
 #include <boost/thread/thread.hpp>
-#include <boost/lockfree/spsc_queue.hpp>
+#include <algorithm>
+#include <fstream>
+#include <limits>
 
 #include "data.hpp"
+#include "fast_double.hpp"
+#include "log.hpp"
 
 #define printf
 
@@ -18,113 +23,227 @@ class svm_reader {
     public:
         example_data& storage;
         const std::string input_file;
-        svm_reader(const std::string input_file, example_data& storage) : input_file(input_file), storage(storage) {
+        svm_reader(const std::string input_file, example_data& storage, size_t n_threads = 0) : input_file(input_file), storage(storage), n_threads(n_threads), start_row(0), max_rows(std::numeric_limits<size_t>::max()), keep_features(NULL) {
             // BOOST_LOG_TRIVIAL(info) << "libsvm file reader initialized with input: " << input_file;
+            if (this->n_threads == 0) {
+                this->n_threads = std::max(1u, boost::thread::hardware_concurrency());
+            }
+        }
+        /*!brief only load examples start_row to start_row + max_rows - 1, using the sidecar line index */
+        void set_range(size_t start_row, size_t max_rows) {
+            this->start_row = start_row;
+            this->max_rows = max_rows;
+        }
+        /*!brief only store feature f if keep[f] is true, features beyond keep are dropped */
+        void set_feature_filter(const std::vector<bool>* keep) {
+            keep_features = keep;
         }
         /*!brief load libsvm format input file */
         bool load() {
-            /* guarantees that all worker threads are on the same NUMA node */
-            /* initialize temp buffers and state variables */
-            parse_buf.reserve(64);
-            parse_buf.clear();
-            state = STATE_NEW;
-            last_is_blank = true;
-            cur_example_id = -1;
-            cur_feature_id = -1; // no features read yet
-            line_no = 0;
-            /* prepare feature buffer */
-            item_buf_index = 0;
-            item_index = 0;
-            item_buf[0] = new std::tuple<i_type, i_type, d_type>[ItemBufferSize];
-            item_buf[1] = new std::tuple<i_type, i_type, d_type>[ItemBufferSize];
-            work_done = true;
-            work_ready = false;
-            exit_worker = false;
-            boost::thread* feat_worker = new boost::thread(boost::bind(&svm_reader::feat_store_proc, this));
-            /* open file */
-            fd = uv_fs_open(uv_default_loop(), &open_req, input_file.c_str(), O_RDONLY, 0, NULL);
+            mapped_input input;
+            if (!map_input(input)) {
+                return false;
+            }
+            if (input.data) {
+                parse_range(input.begin, input.end);
+                munmap(input.data, input.size);
+            }
+            storage.finalize();
+            return true;
+        }
+        /*!
+         * \brief parse the requested examples in order on the calling thread, without storing them:
+         * on_block(first, block) receives up to block_rows examples at a time, first being the index
+         * of block's first example among the requested ones. The callback may swap the block out.
+         */
+        template<typename Callback>
+        bool stream(size_t block_rows, Callback on_block) {
+            mapped_input input;
+            if (!map_input(input)) {
+                return false;
+            }
+            const char* p = input.begin;
+            size_t first = 0;
+            example_data block;
+            while (true) {
+                while (p < input.end && *p <= ' ') p++;
+                if (p < input.end) {
+                    p = parse_example(p, input.end, block);
+                }
+                if (block.size() == block_rows || (p == input.end && block.size() > 0)) {
+                    block.finalize();
+                    size_t n_rows = block.size();
+                    on_block(first, block);
+                    first += n_rows;
+                    example_data empty;
+                    std::swap(block, empty);
+                }
+                if (p == input.end) {
+                    break;
+                }
+            }
+            if (input.data) {
+                munmap(input.data, input.size);
+            }
+            return true;
+        }
+        /*!brief name of the sidecar line index of a LIBSVM file */
+        static std::string index_file(const std::string& input_file) {
+            return input_file + ".idx";
+        }
+    private:
+        /*!brief number of parsing threads */
+        size_t n_threads;
+        /*!brief first example to load */
+        size_t start_row;
+        /*!brief maximum number of examples to load */
+        size_t max_rows;
+        /*!brief features to store, NULL stores all of them */
+        const std::vector<bool>* keep_features;
+        /*!brief the mapped input file and the bytes holding the requested examples */
+        struct mapped_input {
+            char* data;
+            size_t size;
+            const char* begin;
+            const char* end;
+        };
+        /*!brief map the whole file and find the requested examples, data is NULL for an empty file */
+        bool map_input(mapped_input& input) {
+            input.data = NULL;
+            input.size = 0;
+            input.begin = input.end = NULL;
+            /* open and map the whole file */
+            int fd = open(input_file.c_str(), O_RDONLY);
             if (fd == -1) {
                 std::cerr << "Cannot open input file " << input_file;
                 return false;
             }
-            buffers[0] = (char *)malloc(IOBufferSize);
-            buffers[1] = (char *)malloc(IOBufferSize);
-            if (buffers[0] == NULL || buffers[1] == NULL) {
-                std::cerr << "Cannot allocate buffer memory " << input_file;
+            struct stat st;
+            if (fstat(fd, &st) == -1) {
+                std::cerr << "Cannot stat input file " << input_file;
+                close(fd);
                 return false;
             }
-            iov_index = 0;
-            iovs[0] = uv_buf_init(buffers[0], IOBufferSize);
-            iovs[1] = uv_buf_init(buffers[1], IOBufferSize);
-            read_req.data = this;
-            uv_fs_read(uv_default_loop(), &read_req, fd, &iovs[0], 1, -1, svm_reader::on_read);
-            uv_run(uv_default_loop(), UV_RUN_DEFAULT);
-            uv_fs_req_cleanup(&open_req);
-            uv_fs_req_cleanup(&read_req);
-            free(buffers[0]);
-            free(buffers[1]);
-            /* cleanup worker */
-            exit_worker = true;
-            {
-                boost::lock_guard<boost::mutex> lock(work_ready_mux);
-                work_ready = true;
+            size_t file_size = st.st_size;
+            if (file_size == 0) {
+                close(fd);
+                return true;
+            }
+            char* file_data = (char *)mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (file_data == MAP_FAILED) {
+                std::cerr << "Cannot map input file " << input_file;
+                return false;
             }
-            work_ready_cond.notify_one();
-            feat_worker->join();
-            for (size_t i = 0; i < item_index; ++i) {
-                std::tuple<i_type, i_type, d_type>& p = item_buf[item_buf_index][i];
-                storage.add_feature_val(std::get<0>(p), std::get<1>(p), std::get<2>(p));
+            madvise(file_data, file_size, MADV_SEQUENTIAL);
+            input.data = file_data;
+            input.size = file_size;
+            input.begin = file_data;
+            input.end = file_data + file_size;
+            if (start_row > 0 || max_rows != std::numeric_limits<size_t>::max()) {
+                /* seek to the requested examples with the line index */
+                std::vector<uint64_t> offsets;
+                load_line_index(file_data, st, offsets);
+                size_t n_rows = offsets.size() - 1;
+                size_t first = std::min(start_row, n_rows);
+                size_t last = first + std::min(max_rows, n_rows - first);
+                input.begin = file_data + offsets[first];
+                input.end = file_data + offsets[last];
             }
-            delete [] item_buf[0];
-            delete [] item_buf[1];
-            delete feat_worker;
             return true;
         }
-    private:
-        enum paser_states {
-            STATE_NEW, STATE_FEAT, STATE_VAL, STATE_BLANK
+        /*!brief header of the sidecar line index, followed by n_rows + 1 offsets */
+        struct line_index_header {
+            char magic[8];
+            uint64_t file_size;
+            int64_t mtime_sec;
+            int64_t mtime_nsec;
+            uint64_t n_rows;
+        };
+        /*!brief do not split the input into chunks smaller than this */
+        static const size_t MinChunkSize = 1024 * 1024;
+        /*!brief one chunk of the input, counted then parsed by its own thread */
+        struct chunk_parser {
+            const char* begin;
+            const char* end;
+            /*!brief examples and stored values in the chunk, and number of features seen, including dropped ones */
+            size_t n_rows;
+            size_t n_values;
+            size_t n_feat;
+            /*!brief position of the chunk's first example and value in the storage */
+            size_t first_row;
+            size_t first_value;
+            chunk_parser(const char* begin, const char* end) : begin(begin), end(end), n_rows(0), n_values(0), n_feat(0), first_row(0), first_value(0) {
+            }
         };
-        /* variables for libuv */
-        /*!brief read buffer size*/
-        static const size_t IOBufferSize = 8192 * 1024;
-        int fd;
-        uv_fs_t open_req;
-        uv_fs_t read_req;
-        /*!brief double-buffered libuv file IO */
-        uv_buf_t iovs[2];
-        int iov_index;
-        char* buffers[2];
-        /* variables for the state machine */
-        paser_states state;
-        int64_t cur_example_id;
-        double cur_y_value;
-        int64_t cur_feature_id;
-        double cur_feature_value;
-        std::string parse_buf;
-        bool last_is_blank;
-        size_t line_no;
-        /* variables for item buffering and storing */
-        static const size_t ItemBufferSize = 16384;
-        boost::condition_variable work_done_cond;
-        boost::mutex work_done_mux;
-        bool work_done;
-        boost::condition_variable work_ready_cond;
-        boost::mutex work_ready_mux;
-        bool work_ready;
-        boost::atomic<bool> exit_worker;
-        int item_buf_index;
-        int item_index;
-        std::tuple<i_type, i_type, d_type>* item_buf[2];
-        
+
+        /*!brief offset of each example line in the file, plus the file size at the end */
+        void build_line_index(const char* data, size_t size, std::vector<uint64_t>& offsets) {
+            offsets.clear();
+            const char* p = data;
+            const char* end = data + size;
+            while (p < end) {
+                const char* newline = (const char*)memchr(p, '\n', end - p);
+                const char* line_end = newline ? newline : end;
+                /* blank lines are not examples */
+                for (const char* c = p; c < line_end; ++c) {
+                    if (*c > ' ') {
+                        offsets.push_back(p - data);
+                        break;
+                    }
+                }
+                p = line_end + 1;
+            }
+            offsets.push_back(size);
+        }
+
+        /*!brief reuse the sidecar line index if it matches the file, otherwise build and save it */
+        void load_line_index(const char* data, const struct stat& st, std::vector<uint64_t>& offsets) {
+            const std::string idx_file = index_file(input_file);
+            line_index_header header;
+            std::ifstream in(idx_file.c_str(), std::ios::binary);
+            if (in.read((char*)&header, sizeof(header)) && !memcmp(header.magic, "TVLIDX1", 8) &&
+                    header.file_size == uint64_t(st.st_size) && header.mtime_sec == st.st_mtim.tv_sec && header.mtime_nsec == st.st_mtim.tv_nsec) {
+                /* the offsets must fill the rest of the index exactly, so a damaged n_rows is not allocated,
+                 * and must not decrease up to the file size, since they bound the examples that are read */
+                struct stat idx_st;
+                if (stat(idx_file.c_str(), &idx_st) == 0 && uint64_t(idx_st.st_size) > sizeof(header) &&
+                        (uint64_t(idx_st.st_size) - sizeof(header)) / sizeof(uint64_t) == header.n_rows + 1 &&
+                        (uint64_t(idx_st.st_size) - sizeof(header)) % sizeof(uint64_t) == 0) {
+                    offsets.resize(header.n_rows + 1);
+                    if (in.read((char*)&offsets[0], offsets.size() * sizeof(uint64_t)) && offsets.back() == header.file_size &&
+                            std::is_sorted(offsets.begin(), offsets.end())) {
+                        return;
+                    }
+                }
+            }
+            in.close();
+            build_line_index(data, st.st_size, offsets);
+            memcpy(header.magic, "TVLIDX1", 8);
+            header.file_size = st.st_size;
+            header.mtime_sec = st.st_mtim.tv_sec;
+            header.mtime_nsec = st.st_mtim.tv_nsec;
+            header.n_rows = offsets.size() - 1;
+            /* write to a temporary file and rename, so concurrent jobs never see a partial index */
+            std::string tmp_file = idx_file + "." + std::to_string(getpid());
+            std::ofstream out(tmp_file.c_str(), std::ios::binary);
+            out.write((const char*)&header, sizeof(header));
+            out.write((const char*)&offsets[0], offsets.size() * sizeof(uint64_t));
+            out.close();
+            if (!out || rename(tmp_file.c_str(), idx_file.c_str()) != 0) {
+                /* read-only directory etc., just keep the index in memory */
+                unlink(tmp_file.c_str());
+            }
+        }
 
         inline bool isblank(char c) {
             return (c == '\t' || c == ' ');
         }
 
         /*!brief A fast atoi implementation, works for unsigned numbers (feature IDs) only! */
-        inline uint64_t positive_atoi(const char * str ) {
+        inline uint64_t positive_atoi(const char* str, const char* end) {
             uint64_t val = 0;
-            while(isdigit(*str)) {
+            while(str < end && isdigit(*str)) {
                 val = val * 10 + (*str++ - '0');
             }
             return val;
@@ -132,298 +251,161 @@ class svm_reader {
 
 
         /*!
-         * \brief A faster version of strtof
-         * TODO the current version does not support INF, NAN, and hex number
+         * \brief parse the example starting at p (not white space), return the end of its line: on_label(label) gets
+         * its label, then on_feature(index, value) every index:value pair of a kept feature; n_feat grows past every
+         * index seen, including dropped ones. Without ParseValues, numbers are skipped and passed as 0, which is
+         * enough to count the examples and values of a range
          */
-        float strtof(const char *nptr) {
-            const char *p = nptr;
-            // Skip leading white space, if any. Not necessary
-            while (*p <= ' ') ++p;
-
-            // Get sign, if any.
-            bool sign = true;
-            if (*p == '-') {
-                sign = false; ++p;
-            } else if (*p == '+') {
-                ++p;
-            }
-
-            // Get digits before decimal point or exponent, if any.
-            float value;
-            for (value = 0; isdigit(*p); ++p) {
-                value = value * 10.0f + (*p - '0');
-            }
-
-            // Get digits after decimal point, if any.
-            if (*p == '.') {
-                uint64_t pow10 = 1;
-                uint64_t val2 = 0;
-                ++p;
-                while (isdigit(*p)) {
-                    val2 = val2 * 10 + (*p - '0');
-                    pow10 *= 10;
-                    ++p;
-                }
-                value += static_cast<float>(
-                        static_cast<double>(val2) / static_cast<double>(pow10));
-            }
-
-            // Handle exponent, if any.
-            if ((*p == 'e') || (*p == 'E')) {
-                ++p;
-                bool frac = false;
-                float scale = 1.0;
-                unsigned expon;
-                // Get sign of exponent, if any.
-                if (*p == '-') {
-                    frac = true;
-                    ++p;
-                } else if (*p == '+') {
-                    ++p;
-                }
-                // Get digits of exponent, if any.
-                for (expon = 0; isdigit(*p); p += 1) {
-                    expon = expon * 10 + (*p - '0');
-                }
-                if (expon > 38) expon = 38;
-                // Calculate scaling factor.
-                while (expon >=  8) { scale *= 1E8;  expon -=  8; }
-                while (expon >   0) { scale *= 10.0; expon -=  1; }
-                // Return signed and scaled floating point result.
-                value = frac ? (value / scale) : (value * scale);
+        template<bool ParseValues, typename OnLabel, typename OnFeature>
+        const char* parse_line(const char* p, const char* end, size_t& n_feat, OnLabel on_label, OnFeature on_feature) {
+            /* read the label */
+            d_type label = 0;
+            if (ParseValues) {
+                p = parse_double(p, end, label);
             }
-
-            return sign ? value : - value;
-        }
-
-        /*!brief thread for pushing new pairs*/
-        void feat_store_proc () {
-            long long sum = 0;
-            while(true) {
-                {
-                    boost::unique_lock<boost::mutex> lock(work_ready_mux);
-                    //puts("3");
-                    while (!work_ready) {
-                        work_ready_cond.wait(lock);
-                    }
-                    work_ready = false;
-                }
-                if (exit_worker) {
+            /* jump to next white space */
+            while (p < end && *p > ' ') p++;
+            on_label(label);
+            /* process feature index:value pairs until the end of line */
+            while (true) {
+                /* skip white space */
+                while (p < end && isblank(*p)) p++;
+                if (p == end || *p == '\n' || *p == '\r') {
                     break;
                 }
-                //puts("4");
-                int idx = 1 - item_buf_index;
-                // push everything in this block of data
-                for (size_t i = 0; i < ItemBufferSize; ++i) {
-                    std::tuple<i_type, i_type, d_type>& p = item_buf[idx][i];
-                    // sum += std::get<0>(p) + std::get<1>(p) + std::get<2>(p);
-                    storage.add_feature_val(std::get<0>(p), std::get<1>(p), std::get<2>(p));
+                /* read feature ID */
+                const char* token = p;
+                while (p < end && *p != ':' && *p > ' ') p++;
+                if (p == end || *p != ':') {
+                    /* not an index:value pair, ignore it */
+                    continue;
                 }
-                //puts("5");
-                {
-                    boost::lock_guard<boost::mutex> lock(work_done_mux);
-                    work_done = true;
+                size_t index = positive_atoi(token, p);
+                /* read the feature value */
+                d_type val = 0;
+                p++;
+                if (ParseValues) {
+                    p = parse_double(p, end, val);
                 }
-                work_done_cond.notify_one();
-            }
-            // std::cout << sum << std::endl;
-        }
-
-        /*!breif buffer inputs*/ 
-        void push_feature_val (i_type example_index, i_type feature_index, d_type feature_value) {
-            // push new data into buffer
-            item_buf[item_buf_index][item_index] = std::make_tuple(example_index, feature_index, feature_value);
-            item_index++;
-            // switch the buffer
-            if (item_index == ItemBufferSize) {
-                item_index = 0;
-                //puts("1");
-                // wait until worker thread finishes
-                {
-                    boost::unique_lock<boost::mutex> lock(work_done_mux);
-                    while (!work_done) {
-                        work_done_cond.wait(lock);
-                    }
-                    work_done = false;
+                while (p < end && *p > ' ') p++;
+                if (index >= n_feat) {
+                    n_feat = index + 1;
                 }
-                //puts("2");
-                item_buf_index = 1 - item_buf_index; 
-                // signal the worker thread that new buffer is available
-                {
-                    boost::lock_guard<boost::mutex> lock(work_ready_mux);
-                    work_ready = true;
+                if (keep_features && (index >= keep_features->size() || !(*keep_features)[index])) {
+                    continue;
                 }
-                work_ready_cond.notify_one();
+                on_feature(index, val);
             }
+            return p;
         }
 
-        /*!brief process one character of the input. Maintains state. */
-        inline bool process_one(char* pos) {
-            char c = *pos;
-            switch(state) {
-                case STATE_FEAT:
-                    if (c == ':') {
-                        state = STATE_VAL;
-                        cur_feature_id = positive_atoi(parse_buf.c_str());
-                        parse_buf.clear();
-                    }
-                    else {
-                        parse_buf.push_back(c);
-                    }
-                    break;
-                case STATE_VAL:
-                    parse_buf.push_back(c);
-                    if (unlikely(c == '\n' || c == '\r')) {
-                        state = STATE_NEW;
-                        cur_feature_value = strtof(parse_buf.c_str());
-                        parse_buf.clear();
-                        printf("%3ld:%3f\n", cur_feature_id, cur_feature_value);
-                        // storage.add_feature_val(cur_example_id, cur_feature_id, cur_feature_value);
-                        push_feature_val(cur_example_id, cur_feature_id, cur_feature_value);
-                        /* we have processed a full line */
-                        return true;
-                    }
-                    else if (c <= ' ') { // space or tab ('\n' handled above)
-                        state = STATE_BLANK;
-                        cur_feature_value = strtof(parse_buf.c_str());
-                        printf("%3ld:%3f, ", cur_feature_id, cur_feature_value);
-                        // storage.add_feature_val(cur_example_id, cur_feature_id, cur_feature_value);
-                        push_feature_val(cur_example_id, cur_feature_id, cur_feature_value);
-                    }
-                    break;
-                case STATE_BLANK:
-                    if (c > ' ') { // not space, tab and '\n'
-                        state = STATE_FEAT;
-                        parse_buf.clear();
-                        parse_buf.push_back(c);
-                    }
-                    else if (unlikely(c == '\n' || c == '\r')) {
-                        state = STATE_NEW;
-                        printf("\n");
-                        parse_buf.clear();
-                        /* we have processed a full line */
-                        return true;
-                    }
-                    break;
-                case STATE_NEW:
-                    if (isblank(c) && parse_buf.size()) {
-                        state = STATE_BLANK;
-                        cur_example_id++;
-                        cur_y_value = strtof(parse_buf.c_str());
-                        printf("Example %3ld, y=%3f, ", cur_example_id, cur_y_value);
-                        storage.add_y(cur_y_value);
-                    }
-                    else if (c > ' ') { // not space, tab and '\n'
-                        parse_buf.push_back(c);
-                    }
-                    break;
-            }
-            return false;
+        /*!brief parse the example starting at p (not white space) into data, return the end of its line */
+        const char* parse_example(const char* p, const char* end, example_data& data) {
+            i_type example_id = data.size();
+            return parse_line<true>(p, end, data.n_feat,
+                [&](d_type label) { data.add_y(label); },
+                [&](size_t index, d_type val) { data.add_feature_val(example_id, i_type(index), val); });
         }
 
-        /* !brief process a buffer of whole lines */
-        void process_lines(char* lstart, char* lend) {
-            char* convert_start;
-            while (lstart < lend) {
+        /*!brief thread counting the examples and values of one chunk of whole lines */
+        void count_chunk(chunk_parser* chunk) {
+            const char* p = chunk->begin;
+            while (p < chunk->end) {
                 /* skip any white space, empty lines, etc */
-                if (*lstart <= ' ') {
-                    lstart++;
+                if (*p <= ' ') {
+                    p++;
                     continue;
                 }
-                /* read the label */
-                convert_start = lstart;
-                /* jump to next white space */
-                while(*lstart > ' ') lstart++;
-                /* convert the label */
-                double label = strtof(convert_start);
-                cur_example_id++;
-                storage.add_y(label);
-                printf("Example %3ld, y=%3f, ", cur_example_id, label);
-                /* skip white space */
-                while(isblank(*lstart)) lstart++;
-                /* process feature index:value pairs */
-                while(*lstart != '\n' && *lstart != '\r') {
-                    /* read feature ID */
-                    convert_start = lstart;
-                    /* jump to the next char after ':' */
-                    while(*lstart++ != ':');
-                    /* convert feature index */
-                    size_t index = positive_atoi(convert_start);
-                    /* read the feature value */
-                    convert_start = lstart;
-                    /* jump to next white space */
-                    while(*lstart > ' ') lstart++;
-                    /* convert feature value */
-                    double val = strtof(convert_start);
-                    /* skip white space */
-                    while(isblank(*lstart)) lstart++;
-                    // storage.add_feature_val(cur_example_id, index, val);
-                    push_feature_val(cur_example_id, index, val);
-                    printf("%3ld:%3f, ", index, val);
-                }
-                printf("\n");
+                p = parse_line<false>(p, chunk->end, chunk->n_feat,
+                    [&](d_type) { chunk->n_rows++; },
+                    [&](size_t, d_type) { chunk->n_values++; });
             }
         }
 
-        /*!brief process a chunk of data */
-        void process(char* start_ptr, size_t size) {
-            // for(int i = 0; i < size; ++i) putchar(start_ptr[i]);
-            /* stop_ptr points after the last valid char */
-            char* stop_ptr = start_ptr + size;
-            /* Find the last complete line */
-            /* lend points to the last '\n', if found */
-            /* or start_ptr, if no '\n' is found */
-            char* lend_ptr = stop_ptr;
-            while (lend_ptr > start_ptr) {
-                char c = *(--lend_ptr);
-                if (c == '\r' || c == '\n')
-                    break;
-            }
-            /* process the remaining of the last line */
-            /* p will be pointed to the beginning of a new line*/
-            printf("\nprocess begin\n");
-            char* p = start_ptr;
-            if (state != STATE_NEW) {
-                while(p < stop_ptr)
-                    if (process_one(p++))
-                        break;
-            }
-            /* process whole lines */
-            printf("\nprocess lines\n");
-            process_lines(p, lend_ptr);
-            /* process the remaining characters, and maintain state */
-            printf("\nprocess remining\n");
-            if (p != stop_ptr) { // when no new line in this chunk, p == stop_ptr
-                while (lend_ptr < stop_ptr) {
-                    process_one(lend_ptr++);
+        /*!brief thread parsing one chunk of whole lines straight into its place in the storage */
+        void parse_chunk(chunk_parser* chunk) {
+            const char* p = chunk->begin;
+            size_t row = chunk->first_row;
+            size_t value = chunk->first_value;
+            size_t n_feat = 0;
+            while (p < chunk->end) {
+                if (*p <= ' ') {
+                    p++;
+                    continue;
                 }
+                p = parse_line<true>(p, chunk->end, n_feat,
+                    [&](d_type label) { storage.y[row] = label; },
+                    [&](size_t index, d_type val) {
+                        storage.values[value] = val;
+                        storage.col_index[value] = i_type(index);
+                        value++;
+                    });
+                storage.row_ptr[++row] = value;
             }
         }
 
-        /*!brief libuv read callback */
-        static void on_read(uv_fs_t *req) {
-            svm_reader* reader = static_cast<svm_reader*>(req->data);
-            // printf("on_read() called\n");
-            if (req->result < 0) {
-                fprintf(stderr, "Read error: %s\n", uv_strerror(req->result));
+        /*!
+         * \brief parse [begin, end) after the examples already stored, with one thread per chunk: the chunks are
+         * counted first, so the storage is allocated once and each thread writes its examples in place
+         */
+        void parse_range(const char* begin, const char* end) {
+            size_t size = end - begin;
+            size_t n_chunks = std::max(size_t(1), std::min(n_threads, size / MinChunkSize));
+            /* split at line boundaries */
+            std::vector<chunk_parser> chunks;
+            const char* chunk_start = begin;
+            for (size_t i = 1; i <= n_chunks && chunk_start < end; ++i) {
+                const char* chunk_end = end;
+                if (i < n_chunks) {
+                    chunk_end = std::max(chunk_start, begin + size / n_chunks * i);
+                    const char* newline = (const char*)memchr(chunk_end, '\n', end - chunk_end);
+                    chunk_end = newline ? newline + 1 : end;
+                }
+                chunks.push_back(chunk_parser(chunk_start, chunk_end));
+                chunk_start = chunk_end;
+            }
+            boost::thread_group counters;
+            for (size_t i = 0; i < chunks.size(); ++i) {
+                counters.create_thread(boost::bind(&svm_reader::count_chunk, this, &chunks[i]));
             }
-            else if (req->result == 0) {
-                uv_fs_t close_req;
-                printf("closing file\n");
-                uv_fs_close(uv_default_loop(), &close_req, reader->fd, NULL);
+            counters.join_all();
+            /* examples stored before get their empty rows, then the chunks follow in order */
+            while (storage.row_ptr.size() < storage.size() + 1) {
+                storage.row_ptr.push_back(storage.values.size());
             }
-            else if (req->result > 0) {
-                char* buf = reader->iovs[reader->iov_index].base;
-                size_t bytes = req->result;
-                // request next round;
-                printf("\n\n%ld bytes read. requesting more file\n", req->result);
-                // switch buffer and request the next block
-                reader->iov_index = reader->iov_index ^ 0x1;
-                uv_fs_read(uv_default_loop(), &reader->read_req, reader->fd, &reader->iovs[reader->iov_index], 1, -1, svm_reader::on_read);
-                printf("processing...\n\n");
-                reader->process(buf, bytes);
-                printf("\n\ndone.\n\n");
+            size_t n_rows = storage.size();
+            size_t n_values = storage.values.size();
+            for (size_t i = 0; i < chunks.size(); ++i) {
+                chunks[i].first_row = n_rows;
+                chunks[i].first_value = n_values;
+                n_rows += chunks[i].n_rows;
+                n_values += chunks[i].n_values;
+                storage.n_feat = std::max(storage.n_feat, chunks[i].n_feat);
             }
+            storage.y.resize(n_rows);
+            storage.row_ptr.resize(n_rows + 1);
+            storage.values.resize(n_values);
+            storage.col_index.resize(n_values);
+            boost::thread_group parsers;
+            for (size_t i = 0; i < chunks.size(); ++i) {
+                parsers.create_thread(boost::bind(&svm_reader::parse_chunk, this, &chunks[i]));
+            }
+            parsers.join_all();
         }
 };
 
+
+/*!
+ * \brief read a LIBSVM file into CSR storage
+ * Only examples start_row to start_row + max_rows - 1 are loaded, and if keep_features
+ * is given, only the features marked in it are stored.
+ */
+inline void read_libsvm(const std::string& data_file, example_data& data, size_t start_row = 0, size_t max_rows = std::numeric_limits<size_t>::max(), const std::vector<bool>* keep_features = NULL) {
+    svm_reader reader(data_file, data);
+    reader.set_range(start_row, max_rows);
+    reader.set_feature_filter(keep_features);
+    if (!reader.load()) {
+        throw std::invalid_argument("cannot read LIBSVM file " + data_file);
+    }
+    TV_LOG(LOG_INFO) << "\ndata shape:" << data.size() << " * " << data.n_feat << '\n';
+}
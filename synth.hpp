@@ -0,0 +1,194 @@
+/* Synthetic tree ensembles and datasets, for measuring how verification scales with the model */
+
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <stdexcept>
+
+#include "json/single_include/nlohmann/json.hpp"
+
+/*!brief parameters of a synthetic model and dataset */
+struct synth_params {
+    /*!brief number of trees, for multiclass models num_trees rounds of one tree per class */
+    int num_trees;
+    /*!brief every tree is complete with this depth */
+    int depth;
+    /*!brief features are numbered 0 .. num_features-1, values are uniform in [0, 1] */
+    int num_features;
+    int num_classes;
+    int num_points;
+    /*!brief distinct split thresholds per feature, spread evenly over (0, 1); 0 draws them uniformly */
+    int thresholds;
+    uint64_t seed;
+
+    synth_params() : num_trees(10), depth(4), num_features(10), num_classes(2), num_points(100), thresholds(0), seed(2019) {
+    }
+};
+
+/*!brief a complete tree stored by XGBoost node id (children of node i are 2i+1 and 2i+2) */
+struct synth_tree {
+    std::vector<int> split;
+    std::vector<float> threshold;
+    std::vector<float> leaf;
+
+    /*!brief the tree in the format of XGBoost dump_model(dump_format='json') */
+    nlohmann::json to_json(int nodeid, int depth) const {
+        nlohmann::json node;
+        node["nodeid"] = nodeid;
+        if (split[nodeid] < 0) {
+            node["leaf"] = leaf[nodeid];
+            return node;
+        }
+        node["depth"] = depth;
+        node["split"] = split[nodeid];
+        node["split_condition"] = threshold[nodeid];
+        node["yes"] = 2 * nodeid + 1;
+        node["no"] = 2 * nodeid + 2;
+        node["missing"] = 2 * nodeid + 1;
+        node["children"] = {to_json(2 * nodeid + 1, depth + 1), to_json(2 * nodeid + 2, depth + 1)};
+        return node;
+    }
+
+    /*!brief leaf value reached by x, going to "yes" when x[split] < split_condition like XGBoost */
+    float predict(const std::vector<double>& x) const {
+        int nodeid = 0;
+        while (split[nodeid] >= 0) {
+            nodeid = (x[split[nodeid]] < threshold[nodeid]) ? 2 * nodeid + 1 : 2 * nodeid + 2;
+        }
+        return leaf[nodeid];
+    }
+};
+
+/*!brief random complete tree, thresholds are rounded to float as XGBoost stores them */
+inline synth_tree make_synth_tree(const synth_params& params, std::mt19937_64& rng) {
+    std::uniform_int_distribution<int> feature(0, params.num_features - 1);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    std::uniform_int_distribution<int> grid(1, std::max(params.thresholds, 1));
+    std::uniform_real_distribution<double> leaf_value(-0.4, 0.4);
+    int n_internal = (1 << params.depth) - 1;
+    int n_nodes = 2 * n_internal + 1;
+    synth_tree tree;
+    tree.split.assign(n_nodes, -1);
+    tree.threshold.assign(n_nodes, 0);
+    tree.leaf.assign(n_nodes, 0);
+    for (int i = 0; i < n_internal; ++i) {
+        tree.split[i] = feature(rng);
+        if (params.thresholds > 0) {
+            tree.threshold[i] = float(grid(rng) / double(params.thresholds + 1));
+        }
+        else {
+            tree.threshold[i] = float(uniform(rng));
+        }
+    }
+    for (int i = n_internal; i < n_nodes; ++i) {
+        tree.leaf[i] = float(leaf_value(rng));
+    }
+    return tree;
+}
+
+/*!
+ * \brief Write <prefix>.json (model), <prefix>.libsvm (points labelled with the model's own
+ * prediction, so every point starts correctly classified) and <prefix>.config.json (a treeVerify
+ * config for them). The same parameters and seed always give the same files.
+ */
+inline void write_synth(const synth_params& params, const std::string& prefix) {
+    if (params.num_trees < 1 || params.depth < 1 || params.depth > 20 || params.num_features < 1
+            || params.num_classes < 2 || params.num_points < 1 || params.thresholds < 0) {
+        throw std::invalid_argument("invalid synthetic model parameters");
+    }
+    std::mt19937_64 rng(params.seed);
+    /* XGBoost multiclass models store one tree per class per round, tree i is for class i % num_classes */
+    int n_groups = (params.num_classes == 2) ? 1 : params.num_classes;
+    std::vector<synth_tree> trees;
+    nlohmann::json model = nlohmann::json::array();
+    for (int i = 0; i < params.num_trees * n_groups; ++i) {
+        trees.push_back(make_synth_tree(params, rng));
+        model.push_back(trees.back().to_json(0, 0));
+    }
+    std::ofstream model_out(prefix + ".json");
+    model_out << model.dump(2) << '\n';
+    if (!model_out) {
+        throw std::runtime_error("cannot write " + prefix + ".json");
+    }
+
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    FILE* f = fopen((prefix + ".libsvm").c_str(), "w");
+    if (!f) {
+        throw std::runtime_error("cannot write " + prefix + ".libsvm");
+    }
+    std::vector<double> x(params.num_features);
+    std::vector<double> margin(n_groups);
+    for (int n = 0; n < params.num_points; ++n) {
+        for (auto& v : x) {
+            v = uniform(rng);
+        }
+        std::fill(margin.begin(), margin.end(), 0.0);
+        for (size_t i = 0; i < trees.size(); ++i) {
+            margin[i % n_groups] += trees[i].predict(x);
+        }
+        int label = (n_groups == 1) ? int(margin[0] > 0) : int(std::max_element(margin.begin(), margin.end()) - margin.begin());
+        fprintf(f, "%d", label);
+        for (int j = 0; j < params.num_features; ++j) {
+            fprintf(f, " %d:%.17g", j, x[j]);
+        }
+        fputc('\n', f);
+    }
+    if (fclose(f) != 0) {
+        throw std::runtime_error("cannot write " + prefix + ".libsvm");
+    }
+
+    nlohmann::json config;
+    config["inputs"] = prefix + ".libsvm";
+    config["model"] = prefix + ".json";
+    config["start_idx"] = 0;
+    config["num_attack"] = params.num_points;
+    config["eps_init"] = 0.1;
+    config["max_clique"] = 2;
+    config["max_search"] = 10;
+    config["max_level"] = 1;
+    config["num_classes"] = params.num_classes;
+    config["feature_start"] = 0;
+    std::ofstream config_out(prefix + ".config.json");
+    config_out << config.dump(4) << '\n';
+    if (!config_out) {
+        throw std::runtime_error("cannot write " + prefix + ".config.json");
+    }
+}
+
+/*!
+ * \brief treeVerify gen-synth <prefix> [trees=N] [depth=N] [features=N] [classes=N] [points=N] [thresholds=N] [seed=N]
+ */
+inline int gen_synth(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "usage: " << argv[0] << " gen-synth <prefix> [trees=10] [depth=4] [features=10] [classes=2] [points=100] [thresholds=0] [seed=2019]\n";
+        return 1;
+    }
+    synth_params params;
+    for (int i = 3; i < argc; ++i) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        std::string key = arg.substr(0, eq);
+        long long value = (eq == std::string::npos) ? -1 : atoll(arg.c_str() + eq + 1);
+        if (key == "trees") params.num_trees = int(value);
+        else if (key == "depth") params.depth = int(value);
+        else if (key == "features") params.num_features = int(value);
+        else if (key == "classes") params.num_classes = int(value);
+        else if (key == "points") params.num_points = int(value);
+        else if (key == "thresholds") params.thresholds = int(value);
+        else if (key == "seed") params.seed = uint64_t(value);
+        else {
+            std::cerr << "unknown parameter " << arg << '\n';
+            return 1;
+        }
+    }
+    write_synth(params, argv[2]);
+    std::cout << "wrote " << argv[2] << ".json, " << argv[2] << ".libsvm and " << argv[2] << ".config.json: "
+              << params.num_trees << " trees of depth " << params.depth << ", " << params.num_features << " features, "
+              << params.num_classes << " classes, " << params.num_points << " points\n";
+    return 0;
+}
@@ -11,6 +11,8 @@
 #include <chrono>
 #include <random>
 #include "box.hpp"
+#include "log.hpp"
+#include "counters.hpp"
 
 using namespace std;
 using namespace std::chrono;
@@ -18,7 +20,7 @@ using json = nlohmann::json;
 
 
 
-void dfs (json tree, int treeid, interval_map<int, Interval> p_box, vector<Leaf>& Leaf_vec, int class_label){
+void dfs (const json& tree, int treeid, interval_map<int, Interval> p_box, vector<Leaf>& Leaf_vec, int class_label){
   // class_label<0 means this is a binary model
   // p_box is the parent node's bounding box 
   if (tree.find("leaf") != tree.end()){
@@ -29,15 +31,15 @@ void dfs (json tree, int treeid, interval_map<int, Interval> p_box, vector<Leaf>
       int attr = tree["split"]; 
       double threshold = double(tree["split_condition"]); 
       int nodeid = int(tree["nodeid"]);
-      json left_subtree;
-      json right_subtree;
+      const json* left_subtree;
+      const json* right_subtree;
       if (int(tree["children"][0]["nodeid"] == int(tree["yes"])) && int(tree["children"][1]["nodeid"] == int(tree["no"]))) {
-        left_subtree = tree["children"][0];
-        right_subtree = tree["children"][1];
+        left_subtree = &tree["children"][0];
+        right_subtree = &tree["children"][1];
       }
       else if (int(tree["children"][1]["nodeid"] == int(tree["yes"])) && int(tree["children"][0]["nodeid"] == int(tree["no"]))){
-        left_subtree = tree["children"][1];
-        right_subtree = tree["children"][0];
+        left_subtree = &tree["children"][1];
+        right_subtree = &tree["children"][0];
       }
       else{
         throw invalid_argument( "node id not match!" );
@@ -55,16 +57,118 @@ void dfs (json tree, int treeid, interval_map<int, Interval> p_box, vector<Leaf>
         right_box = p_box;
         box_intersec(left_box, build_1D_box(attr, -numeric_limits<float>::max(), threshold));
         box_intersec(right_box, build_1D_box(attr, threshold, numeric_limits<float>::max())); 
-        
       }
-  dfs(left_subtree, treeid, left_box, Leaf_vec, class_label);
-  dfs(right_subtree, treeid, right_box, Leaf_vec, class_label);
+  dfs(*left_subtree, treeid, left_box, Leaf_vec, class_label);
+  dfs(*right_subtree, treeid, right_box, Leaf_vec, class_label);
   }
 }
 
 
 
-tuple<vector<vector<Leaf>>, double> find_k_partite_clique(vector<vector<Leaf>>all_tree_reachable_leaves, int max_clique, double eps, int label, int neg_label, int num_classes, bool dp){
+// estimated memory used by one entry of a clique list
+size_t clique_bytes(const tuple<interval_map<int, Interval>, double>& clique){
+  const interval_map<int, Interval>& box = get<0>(clique);
+  return sizeof(clique) + box.bucket_count() * sizeof(void*) + box.size() * (sizeof(pair<const int, Interval>) + 2 * sizeof(void*));
+}
+
+
+
+// Index of the DP state of find_k_partite_clique, the interval_map counterpart of dp_index in dense.hpp:
+// boxes are sorted by their lower bound on the feature bounded by most of them (axis), the sorted list is
+// cut in blocks that record their largest upper bound on axis and their best value, and a block is
+// skipped when none of its boxes reaches the query on axis or none can improve the best found so far.
+struct clique_dp_index {
+  static const int Block = 16;
+  const vector<tuple<interval_map<int, Interval>, double>>* boxes;
+  bool maximize;
+  int axis;
+  // boxes that can overlap anything (no -100 key), sorted by lower bound on axis, and these bounds
+  vector<int> order;
+  vector<bound_type> lower;
+  vector<bound_type> block_upper;
+  vector<double> block_best;
+
+  clique_dp_index(const vector<tuple<interval_map<int, Interval>, double>>& b, bool max_score) : boxes(&b), maximize(max_score), axis(-100) {
+    interval_map<int, int> bounded;
+    for (int j=0; j<b.size(); j++){
+      const interval_map<int, Interval>& box = get<0>(b[j]);
+      if (box.find(-100) != box.end()){
+        continue;
+      }
+      order.push_back(j);
+      for (auto it = box.cbegin(); it != box.cend(); ++it){
+        int count = ++bounded[it->first];
+        if (axis == -100 || count > bounded[axis]){
+          axis = it->first;
+        }
+      }
+    }
+    vector<bound_type> box_lower(b.size()), box_upper(b.size());
+    for (int j : order){
+      axis_bounds(get<0>(b[j]), box_lower[j], box_upper[j]);
+    }
+    sort(order.begin(), order.end(), [&](int x, int y){ return box_lower[x] < box_lower[y]; });
+    for (int j : order){
+      lower.push_back(box_lower[j]);
+    }
+    for (int start=0; start<order.size(); start+=Block){
+      bound_type up = -numeric_limits<bound_type>::max();
+      double best = get<1>(b[order[start]]);
+      for (int j=start; j<min(int(order.size()), start+Block); j++){
+        up = max(up, box_upper[order[j]]);
+        best = better(best, get<1>(b[order[j]]));
+      }
+      block_upper.push_back(up);
+      block_best.push_back(best);
+    }
+  }
+
+  double better(double a, double b) const { return maximize ? max(a, b) : min(a, b); }
+  bool improves(double a, double b) const { return maximize ? a > b : a < b; }
+
+  // bounds of box on axis, unbounded when box does not constrain axis
+  void axis_bounds(const interval_map<int, Interval>& box, bound_type& lo, bound_type& up) const {
+    auto it = box.find(axis);
+    lo = (it == box.end()) ? -numeric_limits<bound_type>::max() : it->second.lower;
+    up = (it == box.end()) ? numeric_limits<bound_type>::max() : it->second.upper;
+  }
+
+  // best of v + value over the boxes overlapping q, node_best if there is none
+  double best(const interval_map<int, Interval>& q, double v, double node_best, perf_counters* perf = NULL) const {
+    if (q.find(-100) != q.end()){
+      return node_best;
+    }
+    const vector<tuple<interval_map<int, Interval>, double>>& b = *boxes;
+    bound_type q_lower, q_upper;
+    axis_bounds(q, q_lower, q_upper);
+    // boxes with lower bound >= q's upper bound on axis cannot overlap q
+    int end = lower_bound(lower.begin(), lower.end(), q_upper) - lower.begin();
+    for (int start=0, blk=0; start<end; start+=Block, blk++){
+      if (block_upper[blk] <= q_lower){
+        continue;
+      }
+      if (!improves(v + block_best[blk], node_best)){
+        continue;
+      }
+      for (int j=start; j<min(end, start+Block); j++){
+        int m = order[j];
+        double cand = v + get<1>(b[m]);
+        if (!improves(cand, node_best)){
+          continue;
+        }
+        PERF(if (perf) perf->dp_pair_checks++);
+        if (box_overlap(q, get<0>(b[m]))){
+          node_best = cand;
+        }
+      }
+    }
+    return node_best;
+  }
+};
+
+
+
+tuple<vector<vector<Leaf>>, double> find_k_partite_clique(const vector<vector<Leaf>>& all_tree_reachable_leaves, int max_clique, double eps, int label, int neg_label, int num_classes, bool dp, perf_counters* perf = NULL, int level = 0){
   // label is the point's true label
   // if a leaf's label is neg_label, we minus instead of add
   // neg_label is valid only if it's >=0
@@ -79,7 +183,7 @@ tuple<vector<vector<Leaf>>, double> find_k_partite_clique(vector<vector<Leaf>>al
   //}
   //cout << '\n';
   if (dp) {
-    cout << "\n[using DP]\n";
+    TV_LOG(LOG_DEBUG) << "\n[using DP]\n";
   }
   vector<tuple<interval_map<int, Interval>, double>>* DP_best_old;
   vector<tuple<interval_map<int, Interval>, double>>* DP_best_new; 
@@ -101,7 +205,7 @@ tuple<vector<vector<Leaf>>, double> find_k_partite_clique(vector<vector<Leaf>>al
     int buf_idx = 0;
 
     //each element of LL_old/LL_new is a tuple of the intersection box of the clique and sum value 
-    high_resolution_clock::time_point t1 = high_resolution_clock::now();
+    PERF_CLOCK(group_start);
     for (int m=0; m < all_tree_reachable_leaves[start_tree].size(); m++){ 
       double new_leaf_value;
       if (num_classes>2 && neg_label>=0 && all_tree_reachable_leaves[start_tree][m].class_label == neg_label){
@@ -117,6 +221,7 @@ tuple<vector<vector<Leaf>>, double> find_k_partite_clique(vector<vector<Leaf>>al
     for (int k=start_tree+1; k < min(int(all_tree_reachable_leaves.size()), start_tree+max_clique); k++){//loop all trees
       //cout << "\n\n\n" << k << "th tree starts:" << '\n';
       LL_new->clear();
+      PERF(if (perf) perf->at(perf->intersections_tried, level, start_tree / max_clique) += LL_old->size() * all_tree_reachable_leaves[k].size());
       for (int j=0; j < LL_old->size(); j++){//loop all previous cliques
         ////cout << "\n\n" << j << "th clique starts:" << '\n'; 
         for (int m=0; m < all_tree_reachable_leaves[k].size(); m++){//loop nodes in new trees
@@ -138,6 +243,17 @@ tuple<vector<vector<Leaf>>, double> find_k_partite_clique(vector<vector<Leaf>>al
           
         }
       }
+      PERF(if (perf) {
+        perf->at(perf->intersections_found, level, start_tree / max_clique) += LL_new->size();
+        if (LL_new->size() > perf->peak_cliques){
+          perf->peak_cliques = LL_new->size();
+        }
+        size_t bytes = 0;
+        for (int i=0; i<LL_new->size(); i++){
+          bytes += clique_bytes((*LL_new)[i]);
+        }
+        perf->peak_clique_bytes = max(perf->peak_clique_bytes, uint64_t(bytes));
+      });
       
       // LL_old = LL_new;
       // swap two buffers, avoids copy
@@ -145,7 +261,7 @@ tuple<vector<vector<Leaf>>, double> find_k_partite_clique(vector<vector<Leaf>>al
       LL_new = &buffer[(buf_idx+1) & 1];
       //cout << "number of cliques from  "<< start_tree << "th tree to "<< k << "th trees: " << LL_old->size() << '\n';
     }
-    high_resolution_clock::time_point t2 = high_resolution_clock::now();
+    PERF(if (perf) perf->at(perf->group_us, level, start_tree / max_clique) += PERF_US_SINCE(group_start));
     //cout << "----------------------------------clique finding loop ends, final number of cliques: " << int(LL_old->size()) << " ----------------------------------------"<<'\n';
     if (dp){
       if(start_tree==0){
@@ -156,26 +272,11 @@ tuple<vector<vector<Leaf>>, double> find_k_partite_clique(vector<vector<Leaf>>al
       }
       else{
         DP_best_new->clear();
+        bool max_score = label<0.5 && num_classes<=2;
+        clique_dp_index index(*DP_best_old, max_score);
         for (int i=0; i<LL_old->size(); i++){
-          double node_best;
-          if (label<0.5 && num_classes<=2){
-            node_best = - std::numeric_limits<float>::max();
-          }
-          else{
-            node_best = std::numeric_limits<float>::max();
-          }
-          for (int j=0; j<DP_best_old->size(); j++){
-            interval_map<int, Interval> tmp_box = get<0>((*LL_old)[i]);
-            if (!box_intersec(tmp_box, get<0>((*DP_best_old)[j]))){
-              continue;
-            }
-            if (label<0.5 && num_classes<=2){
-              node_best = max(node_best, get<1>((*LL_old)[i])+get<1>((*DP_best_old)[j]));
-            }
-            else{
-              node_best = min(node_best, get<1>((*LL_old)[i])+get<1>((*DP_best_old)[j]));
-            }
-          }
+          double worst = max_score ? - std::numeric_limits<float>::max() : std::numeric_limits<float>::max();
+          double node_best = index.best(get<0>((*LL_old)[i]), get<1>((*LL_old)[i]), worst, perf);
           DP_best_new->emplace_back(make_tuple(get<0>((*LL_old)[i]), node_best));
         }
         DP_best_old = &DP_buffer[(++dp_buf_idx) & 1];
@@ -239,12 +340,12 @@ tuple<vector<vector<Leaf>>, double> find_k_partite_clique(vector<vector<Leaf>>al
 
 
 
-vector<vector<Leaf>> find_reachable_leaves (const vector<double>& x, vector<vector<Leaf>> all_tree_leaves, double eps, int label, int neg_label, int num_classes, int feature_start, bool one_attr, int only_attr){
+vector<vector<Leaf>> find_reachable_leaves (const vector<double>& x, const vector<vector<Leaf>>& all_tree_leaves, double eps, int label, int neg_label, int num_classes, int feature_start, bool one_attr, int only_attr, perf_counters* perf = NULL){
 
   // if neg_label < 0 assume binary model, all trees are used
-  cout << "all tree leaves size: " << all_tree_leaves.size() << std::endl;
+  TV_LOG(LOG_DEBUG) << "all tree leaves size: " << all_tree_leaves.size() << std::endl;
   if (one_attr){
-    cout << "only attribute " << only_attr << " is used!" << std::endl;
+    TV_LOG(LOG_DEBUG) << "only attribute " << only_attr << " is used!" << std::endl;
   }
   vector<vector<Leaf>> all_tree_reachable_leaves;
   vector<Leaf> one_tree_reachable_leaves;
@@ -254,7 +355,7 @@ vector<vector<Leaf>> find_reachable_leaves (const vector<double>& x, vector<vect
     if (num_classes <= 2 || neg_label < 0 || ((i % num_classes) == label) || ((i % num_classes) == neg_label)){
       one_tree_reachable_leaves.clear();
       for (int j=0; j<all_tree_leaves[i].size(); j++){
-        /*cout << "\n!!!!" << point_box_dist(x, all_tree_leaves[i][j].box, -1, feature_start, one_attr, only_attr)<<'\n';
+        /*cout << "\n!!!!" << point_box_dist_norm<NORM_LINF>(x, all_tree_leaves[i][j].box, feature_start, one_attr, only_attr)<<'\n';
         cout <<"nodeid: " << all_tree_leaves[i][j].nodeid << '\t';
         print_box(all_tree_leaves[i][j].box);
         cout << '\t';
@@ -262,12 +363,13 @@ vector<vector<Leaf>> find_reachable_leaves (const vector<double>& x, vector<vect
           cout << it->first << ": "<< x[it->first-feature_start] << '\t';
         }
         */
-        if ((all_tree_leaves[i][j].box.find(-100) == all_tree_leaves[i][j].box.end()) && point_box_dist(x, all_tree_leaves[i][j].box, -1, feature_start, one_attr, only_attr)<=eps) {
+        if ((all_tree_leaves[i][j].box.find(-100) == all_tree_leaves[i][j].box.end()) && (point_box_dist_norm<NORM_LINF>(x, all_tree_leaves[i][j].box, feature_start, one_attr, only_attr)<=eps)) {
           one_tree_reachable_leaves.push_back(all_tree_leaves[i][j]);
         }
       }
       if (one_tree_reachable_leaves.size() < 1)
         throw invalid_argument("number of reachable leaves less than 1, error!");
+      PERF(if (perf) perf->at(perf->reachable_leaves, i) += one_tree_reachable_leaves.size());
       all_tree_reachable_leaves.push_back(one_tree_reachable_leaves);
     }
   }
@@ -280,40 +382,55 @@ vector<vector<Leaf>> find_reachable_leaves (const vector<double>& x, vector<vect
 
 
 
-vector<double> find_multi_level_best_score (const vector<double>& x, int label, int neg_label, vector<vector<Leaf>> all_tree_leaves, int num_classes, int max_level, double eps, int max_clique, int feature_start, bool one_attr, int only_attr, bool must_use_dp){
+/*!brief wall time spent in each stage of verifying a point, in microseconds */
+struct stage_times {
+  double reach;
+  double clique;
+  stage_times() : reach(0), clique(0) {}
+};
+
+
+
+vector<double> find_multi_level_best_score (const vector<double>& x, int label, int neg_label, const vector<vector<Leaf>>& all_tree_leaves, int num_classes, int max_level, double eps, int max_clique, int feature_start, bool one_attr, int only_attr, bool must_use_dp, stage_times* times = NULL, perf_counters* perf = NULL){
   //pick the reachable leaves on each tree
-  vector<vector<Leaf>> all_tree_reachable_leaves = find_reachable_leaves(x, all_tree_leaves, eps, label, neg_label, num_classes, feature_start, one_attr, only_attr);  
+  high_resolution_clock::time_point t1 = high_resolution_clock::now();
+  vector<vector<Leaf>> all_tree_reachable_leaves = find_reachable_leaves(x, all_tree_leaves, eps, label, neg_label, num_classes, feature_start, one_attr, only_attr, perf);  
+  high_resolution_clock::time_point t2 = high_resolution_clock::now();
   //shuffle trees
   //auto rng = std::default_random_engine {};
   //std::shuffle(std::begin(all_tree_reachable_leaves), std::end(all_tree_reachable_leaves), rng);
   
   //print number of reachable leaves on each tree
-  cout << "number of reachable leaves on each tree:" << '\n';
-  for (int i=0; i< all_tree_reachable_leaves.size(); i++){
-    cout << all_tree_reachable_leaves[i].size() << '\n';
-    for (int j=0; j<all_tree_reachable_leaves[i].size();j++){
-      cout<<", "<<all_tree_reachable_leaves[i][j].treeid<<","<<all_tree_reachable_leaves[i][j].nodeid;
+  if (log_level() >= LOG_DEBUG){
+    cout << "number of reachable leaves on each tree:" << '\n';
+    for (int i=0; i< all_tree_reachable_leaves.size(); i++){
+      cout << all_tree_reachable_leaves[i].size() << '\n';
+      for (int j=0; j<all_tree_reachable_leaves[i].size();j++){
+        cout<<", "<<all_tree_reachable_leaves[i][j].treeid<<","<<all_tree_reachable_leaves[i][j].nodeid;
+      }
+      cout<<'\n';
     }
-    cout<<'\n';
+    cout << '\n'; 
   }
-  cout << '\n'; 
   
   vector<double> sum_best;
   vector<vector<Leaf>> new_nodes_array = all_tree_reachable_leaves;
   
   for (int l=0; l<max_level; l++){
-    cout << "\n\n[level " << l << " starts]\n\n";
+    TV_LOG(LOG_DEBUG) << "\n\n[level " << l << " starts]\n\n";
     bool use_dp = (l==max_level-1) && must_use_dp;
     tuple<vector<vector<Leaf>>, double> res;
+    PERF_CLOCK(level_start);
     if (num_classes > 2 && l == 0)
-      res = find_k_partite_clique(new_nodes_array, max_clique, eps, label, neg_label, num_classes, use_dp);
+      res = find_k_partite_clique(new_nodes_array, max_clique, eps, label, neg_label, num_classes, use_dp, perf, l);
     else
-      res = find_k_partite_clique(new_nodes_array, max_clique, eps, label, -1, num_classes, use_dp);
+      res = find_k_partite_clique(new_nodes_array, max_clique, eps, label, -1, num_classes, use_dp, perf, l);
+    PERF(if (perf) perf->at(perf->level_us, l) += PERF_US_SINCE(level_start));
     sum_best.push_back(get<1>(res)); 
     new_nodes_array = get<0>(res); 
     if (new_nodes_array.size() <=1 ){
       //cout << "\nonly one partite left, break level "<< l <<'\n';
-      cout << "reached root, print the best example found:" << std::endl;
+      TV_LOG(LOG_DEBUG) << "reached root, print the best example found:" << std::endl;
       if (label<0.5 && num_classes<=2) {
         // print the max score leaf
         // print_concrete(new_nodes_array[0], x, feature_start, +1);
@@ -325,6 +442,11 @@ vector<double> find_multi_level_best_score (const vector<double>& x, int label,
       break;
     }
   }
+  if (times){
+    high_resolution_clock::time_point t3 = high_resolution_clock::now();
+    times->reach += duration_cast<nanoseconds>(t2 - t1).count() / 1000.0;
+    times->clique += duration_cast<nanoseconds>(t3 - t2).count() / 1000.0;
+  }
 
  return sum_best; 
 }
@@ -0,0 +1,471 @@
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/lock_guard.hpp>
+#include "verifier.hpp"
+#include "dense.hpp"
+#include "certified.hpp"
+
+namespace treeverify {
+
+/*!brief leaves of every tree and the options they were built for, immutable once constructed */
+struct Verifier::model_tables {
+  verifier_options options;
+  // leaves as interval maps, dropped once the dense boxes are built
+  vector<vector<Leaf>> all_tree_leaves;
+  vector<bool> used_features;
+  size_t num_trees;
+  size_t num_leaves;
+  // leaves as dense boxes over the used features, empty unless dense; the boxes are only kept
+  // feature-major in tree_bounds, for the distance kernels, and dense_trees keeps the rest
+  bool dense;
+  feature_map features;
+  vector<box_list> dense_trees;
+  vector<leaf_bounds> tree_bounds;
+  // dense feature of options.only_attr
+  int only_dense;
+  // cliques of level 0 groups, NULL unless dense and options.clique_cache
+  unique_ptr<clique_cache> cache;
+
+  // what is computed once per point: its distances to every leaf when the boxes are dense, which
+  // do not depend on eps
+  struct prepared_point {
+    vector<double> xd;
+    vector<vector<double>> dist;
+  };
+
+  model_tables(const json& model, const verifier_options& opt) : options(opt), num_trees(model.size()), num_leaves(0), dense(false), only_dense(-1) {
+    if (options.num_classes < 2) { options.num_classes = 2; }
+    for (int i=0; i<model.size(); i++){
+      interval_map<int,Interval> no_constr;
+      vector<Leaf> one_tree_leaves;
+      int class_label;
+      if (options.num_classes==2)
+        class_label = -1;
+      else
+        class_label = i % options.num_classes;
+      dfs(model[i], i, no_constr, one_tree_leaves, class_label);
+      TV_LOG(LOG_DEBUG) <<"\n\n" << i <<"th tree\n";
+      num_leaves += one_tree_leaves.size();
+      all_tree_leaves.push_back(std::move(one_tree_leaves));
+    }
+    features.build(all_tree_leaves);
+    used_features.assign(features.dense.size(), false);
+    for (int d=0; d<features.size(); d++){
+      used_features[features.feature[d]] = true;
+    }
+    dense = options.dense_boxes > 0 || (options.dense_boxes < 0 && features.size() <= DenseMaxFeatures);
+    if (dense){
+      Interval unconstrained;
+      unconstrained.lower = -numeric_limits<float>::max();
+      unconstrained.upper = numeric_limits<float>::max();
+      dense_trees = dense_leaves(all_tree_leaves, features, unconstrained);
+      for (int i=0; i<dense_trees.size(); i++){
+        tree_bounds.push_back(leaf_bounds(dense_trees[i]));
+        vector<Interval>().swap(dense_trees[i].bounds);
+      }
+      only_dense = features.dense_attr(options.only_attr, options.feature_start);
+      vector<vector<Leaf>>().swap(all_tree_leaves);
+      TV_LOG(LOG_INFO) << "dense boxes over " << features.size() << " used features, " << simd_name(simd_dispatch_level()) << " distances\n";
+      if (options.clique_cache > 0){
+        cache.reset(new clique_cache(size_t(options.clique_cache * 1024 * 1024)));
+      }
+    }
+  }
+
+  void prepare(const vector<double>& x, prepared_point& p) const {
+    if (dense){
+      features.project(x, options.feature_start, p.xd);
+      p.dist.resize(tree_bounds.size());
+      for (int i=0; i<tree_bounds.size(); i++){
+        tree_bounds[i].distances(p.xd, options.only_attr != -100, only_dense, p.dist[i]);
+      }
+    }
+  }
+
+  // prepare the points todo of a batch, the others are left empty; the distances are computed tree
+  // by tree, so the bounds of a tree are read from memory once for the whole batch
+  void prepare(const vector<vector<double>>& xs, const vector<int>& todo, vector<prepared_point>& ps) const {
+    ps.resize(xs.size());
+    if (!dense){
+      for (int j=0; j<todo.size(); j++){
+        prepare(xs[todo[j]], ps[todo[j]]);
+      }
+      return;
+    }
+    for (int j=0; j<todo.size(); j++){
+      features.project(xs[todo[j]], options.feature_start, ps[todo[j]].xd);
+      ps[todo[j]].dist.resize(tree_bounds.size());
+    }
+    for (int i=0; i<tree_bounds.size(); i++){
+      for (int j=0; j<todo.size(); j++){
+        tree_bounds[i].distances(ps[todo[j]].xd, options.only_attr != -100, only_dense, ps[todo[j]].dist[i]);
+      }
+    }
+  }
+
+  vector<double> best_scores(const vector<double>& x, const prepared_point& p, int label, int neg_label, double eps, stage_times* times, perf_counters* perf) const;
+  verify_result verify(const vector<double>& x, const prepared_point& p, int label, double eps, perf_counters* perf) const;
+  bound_result max_eps(const vector<double>& x, const prepared_point& p, int label, double eps_init, int max_search, double reused, perf_counters* perf, steady_clock::time_point deadline) const;
+};
+
+
+/*!brief a certified_index per label, and the columns of x the model splits on */
+struct certified_bounds::index {
+  vector<int> columns;
+  bool enabled;
+  mutable boost::mutex mux;
+  map<int, certified_index> labels;
+
+  // the used features of x, missing ones are 0 as in the server
+  void project(const vector<double>& x, vector<double>& xd) const {
+    xd.resize(columns.size());
+    for (int d=0; d<columns.size(); d++){
+      xd[d] = (columns[d] < x.size()) ? x[columns[d]] : 0.0;
+    }
+  }
+};
+
+
+// the search of max_eps when the bound reused for x reaches eps_init
+static bound_result reused_bound(double reused){
+  bound_result res;
+  res.bound = reused;
+  res.reused = reused;
+  res.initially_robust = true;
+  return res;
+}
+
+
+verifier_options verifier_options::from_config(const json& config){
+  verifier_options options;
+  if (config.find("num_classes") != config.end()) options.num_classes = int(config["num_classes"]);
+  if (config.find("max_clique") != config.end()) options.max_clique = int(config["max_clique"]);
+  if (config.find("max_level") != config.end()) options.max_level = int(config["max_level"]);
+  if (config.find("max_search") != config.end()) options.max_search = int(config["max_search"]);
+  if (config.find("eps_init") != config.end()) options.eps_init = double(config["eps_init"]);
+  if (config.find("feature_start") != config.end()) options.feature_start = int(config["feature_start"]);
+  if (config.find("dp") != config.end()) options.dp = bool(int(config["dp"]));
+  if (config.find("one_attr") != config.end()) options.only_attr = int(config["one_attr"]);
+  if (config.find("dense_boxes") != config.end()) options.dense_boxes = int(config["dense_boxes"]);
+  if (config.find("join") != config.end()) options.join = int(config["join"]);
+  if (config.find("clique_cache") != config.end()) options.clique_cache = double(config["clique_cache"]);
+  return options;
+}
+
+
+static json read_model(const string& model_file){
+  ifstream tree_data(model_file);
+  if (!tree_data){
+    throw invalid_argument("cannot open model file " + model_file);
+  }
+  json model;
+  tree_data >> model;
+  return model;
+}
+
+
+Verifier::Verifier(const string& model_file, const verifier_options& options) : model_(make_shared<const model_tables>(read_model(model_file), options)) {
+}
+
+
+Verifier::Verifier(const json& model, const verifier_options& options) : model_(make_shared<const model_tables>(model, options)) {
+}
+
+
+const verifier_options& Verifier::options() const {
+  return model_->options;
+}
+
+
+size_t Verifier::num_trees() const {
+  return model_->num_trees;
+}
+
+
+size_t Verifier::num_leaves() const {
+  return model_->num_leaves;
+}
+
+
+const vector<bool>& Verifier::used_features() const {
+  return model_->used_features;
+}
+
+
+bool Verifier::dense_boxes() const {
+  return model_->dense;
+}
+
+
+cache_stats Verifier::clique_cache_stats() const {
+  cache_stats stats;
+  clique_cache* cache = model_->cache.get();
+  if (cache){
+    boost::lock_guard<boost::mutex> lock(cache->mux);
+    stats.hits = cache->hits;
+    stats.misses = cache->misses;
+    stats.entries = cache->lru.size();
+    stats.bytes = cache->bytes;
+  }
+  return stats;
+}
+
+
+verify_result Verifier::verify(const vector<double>& x, int label, double eps, perf_counters* perf, certified_bounds* reuse) const {
+  double reused = reuse ? reuse->lower_bound(x, label) : 0;
+  if (reused > 0 && reused >= eps){
+    verify_result res;
+    res.robust = true;
+    res.reused = reused;
+    return res;
+  }
+  model_tables::prepared_point p;
+  high_resolution_clock::time_point t1 = high_resolution_clock::now();
+  model_->prepare(x, p);
+  high_resolution_clock::time_point t2 = high_resolution_clock::now();
+  verify_result res = model_->verify(x, p, label, eps, perf);
+  res.reach_us += duration_cast<nanoseconds>(t2 - t1).count() / 1000.0;
+  res.reused = reused;
+  if (reuse && res.robust){
+    reuse->insert(x, label, eps);
+  }
+  return res;
+}
+
+
+bound_result Verifier::max_eps(const vector<double>& x, int label, perf_counters* perf, certified_bounds* reuse) const {
+  return max_eps(x, label, model_->options.eps_init, model_->options.max_search, perf, reuse);
+}
+
+
+bound_result Verifier::max_eps(const vector<double>& x, int label, double eps_init, int max_search, perf_counters* perf, certified_bounds* reuse, steady_clock::time_point deadline) const {
+  // the distances are computed once for all the eps tried, and counted as finding reachable leaves
+  high_resolution_clock::time_point t1 = high_resolution_clock::now();
+  double reused = reuse ? reuse->lower_bound(x, label) : 0;
+  if (reused > 0 && reused >= eps_init){
+    bound_result res = reused_bound(reused);
+    res.total_us = duration_cast<nanoseconds>(high_resolution_clock::now() - t1).count() / 1000.0;
+    return res;
+  }
+  model_tables::prepared_point p;
+  model_->prepare(x, p);
+  high_resolution_clock::time_point t2 = high_resolution_clock::now();
+  bound_result res = model_->max_eps(x, p, label, eps_init, max_search, reused, perf, deadline);
+  high_resolution_clock::time_point t3 = high_resolution_clock::now();
+  res.reach_us += duration_cast<nanoseconds>(t2 - t1).count() / 1000.0;
+  res.total_us = duration_cast<nanoseconds>(t3 - t1).count() / 1000.0;
+  if (reuse && res.bound > reused){
+    reuse->insert(x, label, res.bound);
+  }
+  return res;
+}
+
+
+vector<bound_result> Verifier::max_eps(const vector<vector<double>>& points, const vector<int>& labels, vector<perf_counters>* perf, certified_bounds* reuse,
+                                       const vector<steady_clock::time_point>* deadlines) const {
+  if (points.size() != labels.size() || (deadlines && deadlines->size() != points.size())){
+    throw invalid_argument("number of points, labels and deadlines differ");
+  }
+  const verifier_options& opt = model_->options;
+  // bounds only grow as points are added, so a point whose search is already skipped now is also
+  // skipped at its turn, and its distances are not computed
+  vector<int> todo;
+  high_resolution_clock::time_point t1 = high_resolution_clock::now();
+  for (int n=0; n<points.size(); n++){
+    double reused = reuse ? reuse->lower_bound(points[n], labels[n]) : 0;
+    if (!(reused > 0 && reused >= opt.eps_init)){
+      todo.push_back(n);
+    }
+  }
+  vector<model_tables::prepared_point> ps;
+  model_->prepare(points, todo, ps);
+  high_resolution_clock::time_point t2 = high_resolution_clock::now();
+  // every point is charged an equal share of the batched distances
+  double prepare_us = points.empty() ? 0 : duration_cast<nanoseconds>(t2 - t1).count() / 1000.0 / points.size();
+  if (perf){
+    perf->assign(points.size(), perf_counters());
+  }
+  vector<bound_result> res;
+  for (int n=0; n<points.size(); n++){
+    high_resolution_clock::time_point t3 = high_resolution_clock::now();
+    // looked up again at its turn, so that the points verified just before count
+    double reused = reuse ? reuse->lower_bound(points[n], labels[n]) : 0;
+    if (reused > 0 && reused >= opt.eps_init){
+      res.push_back(reused_bound(reused));
+    }
+    else {
+      res.push_back(model_->max_eps(points[n], ps[n], labels[n], opt.eps_init, opt.max_search, reused, perf ? &(*perf)[n] : NULL,
+                                    deadlines ? (*deadlines)[n] : steady_clock::time_point::max()));
+      if (reuse && res.back().bound > reused){
+        reuse->insert(points[n], labels[n], res.back().bound);
+      }
+    }
+    high_resolution_clock::time_point t4 = high_resolution_clock::now();
+    res.back().reach_us += prepare_us;
+    res.back().total_us = prepare_us + duration_cast<nanoseconds>(t4 - t3).count() / 1000.0;
+  }
+  return res;
+}
+
+
+vector<double> Verifier::model_tables::best_scores(const vector<double>& x, const prepared_point& p, int label, int neg_label, double eps, stage_times* times, perf_counters* perf) const {
+  const verifier_options& opt = options;
+  bool one_attr = (opt.only_attr != -100);
+  if (dense){
+    return find_multi_level_best_score_dense(p.dist, label, neg_label, dense_trees, tree_bounds, opt.num_classes, opt.max_level, eps, opt.max_clique, opt.dp, opt.join, times, perf, cache.get());
+  }
+  return find_multi_level_best_score(x, label, neg_label, all_tree_leaves, opt.num_classes, opt.max_level, eps, opt.max_clique, opt.feature_start, one_attr, opt.only_attr, opt.dp, times, perf);
+}
+
+
+verify_result Verifier::model_tables::verify(const vector<double>& x, const prepared_point& p, int label, double eps, perf_counters* perf) const {
+  const verifier_options& opt = options;
+  verify_result res;
+  stage_times times;
+  res.robust = true;
+  if (opt.num_classes <= 2){
+    TV_LOG(LOG_STEPS) << "\n^^^^^^^^^^^^^^^^ binary model  ^^^^^^^^^^^^^^^\n";
+    res.scores = best_scores(x, p, label, -1, eps, &times, perf);
+    res.robust = (label<0.5&&res.scores.back()<0)||(label>0.5&&res.scores.back()>0);
+  }
+  else{
+    TV_LOG(LOG_STEPS) << "\n^^^^^^^^^^^^^^^^ " << opt.num_classes  << "  classes model  ^^^^^^^^^^^^^^^\n";
+    for (int neg_label=0; neg_label<opt.num_classes; neg_label++){
+      if (neg_label != label){
+        TV_LOG(LOG_STEPS) << "\n^^^^^^^^^^^^^^^^ original class: " << label  << " target class: " << neg_label << " starts ^^^^^^^^^^^^^^^\n";
+        res.scores = best_scores(x, p, label, neg_label, eps, &times, perf);
+        if (log_level() >= LOG_STEPS){
+          cout << "\n best score for each level:\t";
+          for (int i=0;i<res.scores.size(); i++){
+            cout << res.scores[i] <<'\t';
+          }
+        }
+
+        res.robust = res.robust && (res.scores.back()>0);
+        if (!res.robust){
+          break;
+        }
+      }
+    }
+  }
+  res.reach_us = times.reach;
+  res.clique_us = times.clique;
+  return res;
+}
+
+
+bound_result Verifier::model_tables::max_eps(const vector<double>& x, const prepared_point& p, int label, double eps_init, int max_search, double reused, perf_counters* perf, steady_clock::time_point deadline) const {
+  // reused, if above 0, is known robust and counts as the last robust eps before the first step
+  bound_result res;
+  res.reused = reused;
+  double eps = eps_init;
+  bool has_rob = reused > 0;
+  bool has_unrob = false;
+  double last_rob = reused;
+  double last_unrob = 0;
+  for (int search_step=0; search_step<max_search; search_step++){
+    // the first step always runs, so that initially_robust is known
+    if (search_step > 0 && steady_clock::now() >= deadline){
+      res.expired = true;
+      break;
+    }
+    PERF_CLOCK(step_start);
+    TV_LOG(LOG_STEPS) << "\n\n************** eps=" << eps << " starts ******************\n";
+    verify_result step = verify(x, p, label, eps, perf);
+    res.reach_us += step.reach_us;
+    res.clique_us += step.clique_us;
+    bool robust = step.robust;
+    // at the first search, evaluate the verified error
+    if (search_step == 0) {
+      res.initially_robust = robust;
+    }
+    PERF(if (perf) perf->at(perf->eps_step_us, search_step) += PERF_US_SINCE(step_start));
+    TV_LOG(LOG_STEPS) << "Can model be guaranteed robust within eps " << eps << "? (0 for no, 1 for yes): " << robust  <<'\n';
+    res.robust.push_back(robust);
+    res.eps.push_back(eps);
+    if (robust) {
+      has_rob = true;
+      last_rob = eps;
+    }
+    else {
+      has_unrob = true;
+      last_unrob = eps;
+    }
+
+    if (!has_rob) {
+      eps = eps * 0.5;
+    }
+    else {
+      if (!has_unrob){
+        if (eps >= 1){
+          TV_LOG(LOG_STEPS) << "\n eps >=1, break binary search!\n";
+          break;
+        }
+        eps = min(eps * 2.0, 1.0);
+      }
+      else {
+        eps = 0.5 * (last_rob + last_unrob);
+      }
+    }
+
+    TV_LOG(LOG_STEPS) << "\n**************** this eps ends, next eps:" << eps  <<" *********************\n";
+  }
+  if (has_rob){
+    res.bound = last_rob;
+  }
+  return res;
+}
+
+
+certified_bounds::certified_bounds(const Verifier& verifier) : index_(new index) {
+  const vector<bool>& used = verifier.used_features();
+  int feature_start = verifier.options().feature_start;
+  for (int f=max(feature_start, 0); f<used.size(); f++){
+    if (used[f]){
+      index_->columns.push_back(f - feature_start);
+    }
+  }
+  index_->enabled = (verifier.options().only_attr == -100);
+}
+
+
+certified_bounds::~certified_bounds() {
+}
+
+
+double certified_bounds::lower_bound(const vector<double>& x, int label) const {
+  if (!index_->enabled){
+    return 0;
+  }
+  vector<double> xd;
+  index_->project(x, xd);
+  boost::lock_guard<boost::mutex> lock(index_->mux);
+  map<int, certified_index>::const_iterator it = index_->labels.find(label);
+  return (it == index_->labels.end()) ? 0 : it->second.lower_bound(xd.data());
+}
+
+
+void certified_bounds::insert(const vector<double>& x, int label, double bound){
+  if (!index_->enabled || bound <= 0){
+    return;
+  }
+  vector<double> xd;
+  index_->project(x, xd);
+  boost::lock_guard<boost::mutex> lock(index_->mux);
+  map<int, certified_index>::iterator it = index_->labels.find(label);
+  if (it == index_->labels.end()){
+    it = index_->labels.insert(make_pair(label, certified_index(xd.size()))).first;
+  }
+  it->second.insert(xd.data(), bound);
+}
+
+
+size_t certified_bounds::size() const {
+  boost::lock_guard<boost::mutex> lock(index_->mux);
+  size_t n = 0;
+  for (map<int, certified_index>::const_iterator it = index_->labels.begin(); it != index_->labels.end(); ++it){
+    n += it->second.size();
+  }
+  return n;
+}
+
+}
@@ -0,0 +1,167 @@
+/* Verification engine: load a tree ensemble once, then verify any number of points against it */
+
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include "json/single_include/nlohmann/json.hpp"
+#include "counters.hpp"
+
+namespace treeverify {
+
+/*!brief largest number of used features for which dense boxes are chosen automatically */
+const int DenseMaxFeatures = 64;
+
+/*!brief search parameters, named after the keys of the configuration file */
+struct verifier_options {
+  int num_classes;
+  int max_clique;
+  int max_level;
+  /*!brief number of eps values tried by max_eps */
+  int max_search;
+  /*!brief first eps tried by max_eps */
+  double eps_init;
+  /*!brief index of the first feature, x[i] is feature i + feature_start */
+  int feature_start;
+  bool dp;
+  /*!brief only perturb this feature, -100 perturbs all of them */
+  int only_attr;
+  /*!brief store boxes densely over the used features, see dense.hpp: 1 always, 0 never, -1 when the model uses at most DenseMaxFeatures features */
+  int dense_boxes;
+  /*!brief how dense cliques are joined with the next tree: 1 sweep line, 0 all pairs, -1 sweep line on large joins */
+  int join;
+  /*!brief size of the cache of level 0 cliques shared by all points, in MB, 0 for none; dense boxes only */
+  double clique_cache;
+
+  verifier_options() : num_classes(2), max_clique(2), max_level(1), max_search(10), eps_init(0.3), feature_start(1), dp(false), only_attr(-100), dense_boxes(-1), join(-1), clique_cache(0) {}
+
+  /*!brief options given in a configuration file, the missing ones keep their defaults */
+  static verifier_options from_config(const nlohmann::json& config);
+};
+
+/*!brief outcome of verifying one point at one eps */
+struct verify_result {
+  /*!brief true if no point within eps can change the predicted label */
+  bool robust;
+  /*!brief best score found at each level, for the last target class tried on multiclass models */
+  std::vector<double> scores;
+  /*!brief time spent finding reachable leaves and cliques, microseconds */
+  double reach_us;
+  double clique_us;
+  /*!brief bound reused from a nearby verified point, 0 if none; when it reaches eps, robust is set without verifying and scores is empty */
+  double reused;
+
+  verify_result() : robust(false), reach_us(0), clique_us(0), reused(0) {}
+};
+
+/*!brief outcome of the binary search for the largest verified eps */
+struct bound_result {
+  /*!brief largest eps verified robust, 0 if none was */
+  double bound;
+  /*!brief true if the point is robust at eps_init, which defines the verified error */
+  bool initially_robust;
+  /*!brief every eps tried, in order, and whether it was verified robust */
+  std::vector<double> eps;
+  std::vector<bool> robust;
+  double reach_us;
+  double clique_us;
+  /*!brief time spent on this point, microseconds, including its share of the work done for its batch */
+  double total_us;
+  /*!brief bound reused from a nearby verified point, 0 if none; the search starts from it, and is skipped
+   * (eps is empty and bound is the reused bound) when it reaches eps_init */
+  double reused;
+  /*!brief true if the search stopped at its deadline before max_search steps; bound is the best found so far */
+  bool expired;
+
+  bound_result() : bound(0), initially_robust(false), reach_us(0), clique_us(0), total_us(0), reused(0), expired(false) {}
+};
+
+/*!brief use of the clique cache since the Verifier was built */
+struct cache_stats {
+  uint64_t hits;
+  uint64_t misses;
+  /*!brief entries held and their estimated size */
+  size_t entries;
+  size_t bytes;
+
+  cache_stats() : hits(0), misses(0), entries(0), bytes(0) {}
+};
+
+class certified_bounds;
+
+/*!
+ * \brief A tree ensemble ready for verification.
+ * The leaf tables are built once by the constructor and never modified, so the const methods can be
+ * called from any number of threads at the same time, and copies of a Verifier share the tables.
+ * The clique cache, if any, is shared the same way and locks itself.
+ * Points are dense vectors: x[i] is the value of feature i + options().feature_start, and label is
+ * the class predicted for x (0 or 1 for binary models).
+ */
+class Verifier {
+ public:
+  /*!brief load a model dumped by XGBoost in JSON format, throws invalid_argument on failure */
+  Verifier(const std::string& model_file, const verifier_options& options);
+  /*!brief use an already parsed model */
+  Verifier(const nlohmann::json& model, const verifier_options& options);
+
+  /*!brief verify x at a single eps. With reuse, a bound reused from a nearby point may answer without
+   * verifying, and x is added to reuse if it is verified robust */
+  verify_result verify(const std::vector<double>& x, int label, double eps, perf_counters* perf = NULL, certified_bounds* reuse = NULL) const;
+  /*!brief binary search for the largest eps at which x is verified robust, starting at eps_init. With reuse, the
+   * search starts from the bound reused from a nearby point, and x is added to reuse with the bound found */
+  bound_result max_eps(const std::vector<double>& x, int label, perf_counters* perf = NULL, certified_bounds* reuse = NULL) const;
+  /*!brief binary search with its own first eps and number of steps. Once deadline has passed, the search
+   * stops before its next eps step and the result is marked expired */
+  bound_result max_eps(const std::vector<double>& x, int label, double eps_init, int max_search, perf_counters* perf = NULL, certified_bounds* reuse = NULL,
+                       std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max()) const;
+  /*!brief max_eps for a batch of points and their labels. With dense boxes, the distances of every point to
+   * the leaves of a tree are computed together while that tree is in cache. perf, if given, gets one entry per point.
+   * With reuse, the points are looked up and added in order, so a point can reuse the bound of an earlier one.
+   * deadlines, if given, has the deadline of each point */
+  std::vector<bound_result> max_eps(const std::vector<std::vector<double>>& points, const std::vector<int>& labels, std::vector<perf_counters>* perf = NULL, certified_bounds* reuse = NULL,
+                                    const std::vector<std::chrono::steady_clock::time_point>* deadlines = NULL) const;
+
+  const verifier_options& options() const;
+  size_t num_trees() const;
+  size_t num_leaves() const;
+  /*!brief used_features()[f] is true if some split of the model tests feature f */
+  const std::vector<bool>& used_features() const;
+  /*!brief true if the leaf boxes are stored densely over the used features */
+  bool dense_boxes() const;
+  /*!brief hits and misses of the clique cache, all 0 without one */
+  cache_stats clique_cache_stats() const;
+
+ private:
+  struct model_tables;
+  std::shared_ptr<const model_tables> model_;
+};
+
+/*!
+ * \brief Certified bounds of the points verified with one Verifier, reused for nearby points.
+ * If x is verified robust within r and x' has the same label at L-inf distance d < r from x, over the
+ * features the model splits on, x' is robust within r - d. The points of each label are kept in a
+ * k-d tree over those features, which a lookup only descends where a box is near enough to beat the
+ * best bound found so far. The methods can be called from any number of threads at the same time. Nothing is reused when only
+ * one feature is perturbed (only_attr), since the distance then has to be 0 on every other feature.
+ */
+class certified_bounds {
+ public:
+  explicit certified_bounds(const Verifier& verifier);
+  ~certified_bounds();
+
+  /*!brief largest r - d over the stored points of this label, 0 if x is not closer to any of them than its bound */
+  double lower_bound(const std::vector<double>& x, int label) const;
+  /*!brief store x, verified robust within bound */
+  void insert(const std::vector<double>& x, int label, double bound);
+  /*!brief number of points stored */
+  size_t size() const;
+
+ private:
+  struct index;
+  std::unique_ptr<index> index_;
+  certified_bounds(const certified_bounds&);
+  certified_bounds& operator=(const certified_bounds&);
+};
+
+}